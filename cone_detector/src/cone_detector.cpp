@@ -11,9 +11,11 @@
  */
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 
 #include <list>
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 
 #include <geometry_msgs/PointStamped.h>
 #include <sensor_msgs/LaserScan.h>
@@ -23,6 +25,17 @@
 #include <dynamic_reconfigure/server.h>
 #include <cone_detector/ConeDetectorConfig.h>
 
+#include <mem_account/mem_global_new.h>
+#include <mem_account/mem_report.h>
+
+// memory accounting tags; see mem_account.h
+enum mem_tag {
+   MEM_TF = 0,  // the tf buffer, and the messages that fill it
+   MEM_TAGS
+};
+
+const char * const mem_tag_names[MEM_TAGS] = { "tf" };
+
 double dist(geometry_msgs::Point a, geometry_msgs::Point b) {
    return hypot(a.x - b.x, a.y - b.y);
 }
@@ -34,9 +47,16 @@ double dist(geometry_msgs::PointStamped a, geometry_msgs::PointStamped b) {
 class ConeDetector {
 private:
    ros::NodeHandle n;
+   // tf gets its own queue and thread, so what its 20 s buffer allocates
+   //  is counted against MEM_TF
+   ros::CallbackQueue tf_queue;
+   ros::NodeHandle tf_n;
    tf::TransformListener listener;
+   boost::thread tf_thread;
    ros::Subscriber laser_sub;
    ros::Publisher marker_pub;
+   ros::Publisher memory_pub;
+   ros::Timer memory_timer;
    dynamic_reconfigure::Server<cone_detector::ConeDetectorConfig> server;
 
    // last seen and point
@@ -50,10 +70,42 @@ private:
    double same_cone_threshold;
    double min_cone_radius;
    double max_cone_radius;
+
+   // a node handle whose callbacks go to queue
+   static ros::NodeHandle queued(ros::CallbackQueue & queue) {
+      ros::NodeHandle h;
+      h.setCallbackQueue(&queue);
+      return h;
+   }
+
+   void tfThread() {
+      mem_scope scope(MEM_TF);
+      while( ros::ok() ) {
+         tf_queue.callAvailable(ros::WallDuration(0.1));
+      }
+   }
+
+   void memoryCb(const ros::TimerEvent &) {
+      mem_account::MemoryUsage m;
+      mem_report(m);
+      memory_pub.publish(m);
+   }
 public:
-   ConeDetector() : listener(n, ros::Duration(20.0)) {
+   ConeDetector() : tf_n(queued(tf_queue)),
+         listener(tf_n, ros::Duration(20.0), false),
+         tf_thread(&ConeDetector::tfThread, this) {
       laser_sub = n.subscribe("scan", 1, &ConeDetector::laserCallback, this);
       marker_pub = n.advertise<visualization_msgs::Marker>("cone_markers", 1);;
+
+      // memory per subsystem; 0 disables
+      double memory_rate = 0.2;
+      n.getParam("memory_rate", memory_rate);
+      if( memory_rate > 0 ) {
+         memory_pub = n.advertise<mem_account::MemoryUsage>("memory_usage",
+               1);
+         memory_timer = n.createTimer(ros::Duration(1.0 / memory_rate),
+               &ConeDetector::memoryCb, this);
+      }
       
       min_circle_size = 4;
       grouping_threshold = 0.05;
@@ -66,6 +118,10 @@ public:
                this, _1, _2));
    }
 
+   ~ConeDetector() {
+      tf_thread.join();
+   }
+
    void laserCallback(const sensor_msgs::LaserScan::ConstPtr & msg) {
       std::list<std::list<geometry_msgs::Point> > groups;
       groups.push_back(std::list<geometry_msgs::Point>());
@@ -239,6 +295,7 @@ public:
 
 int main(int argc, char ** argv) {
    ros::init(argc, argv, "cone_detector");
+   mem_name_tags(mem_tag_names, MEM_TAGS);
 
    ConeDetector detector;
 
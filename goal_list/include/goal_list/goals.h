@@ -0,0 +1,29 @@
+/* goals.h
+ *
+ * The goal list, with its storage counted by mem_account.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_GOALS_H
+#define DAGNY_GOALS_H
+
+#include <vector>
+
+#include <sensor_msgs/NavSatFix.h>
+
+#include <mem_account/mem_account.h>
+
+// memory accounting tags; see mem_account.h
+enum mem_tag {
+   MEM_GOALS = 0,  // the goal list
+   MEM_TAGS
+};
+
+const char * const mem_tag_names[MEM_TAGS] = { "goals" };
+
+// counts the goals themselves; their frame_id strings aren't counted
+typedef std::vector<sensor_msgs::NavSatFix,
+        tagged_allocator<sensor_msgs::NavSatFix, MEM_GOALS> > goal_vector;
+
+#endif
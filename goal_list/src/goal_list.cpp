@@ -21,11 +21,13 @@
 
 #include <nav_msgs/Odometry.h>
 
+#include <goal_list/goals.h>
 #include <goal_list/gps.h>
+#include <mem_account/mem_report.h>
 
 using namespace std;
 
-vector<sensor_msgs::NavSatFix> * goals;
+goal_vector * goals;
 unsigned int current_goal;
 
 bool loop = false;
@@ -80,7 +82,7 @@ void goalInputCallback(const dagny_driver::Goal::ConstPtr & goal) {
          {
             ROS_INFO("Removing goal at %d", goal->id);
 
-            vector<sensor_msgs::NavSatFix>::iterator itr = goals->begin();
+            goal_vector::iterator itr = goals->begin();
             int id = goal->id;
             while( id ) {
                ++itr;
@@ -132,11 +134,21 @@ void gpsCallback(const sensor_msgs::NavSatFix::ConstPtr & msg) {
    }
 }
 
+// memory held by the goal list; see goals.h
+ros::Publisher memory_pub;
+
+void memoryCb(const ros::TimerEvent &) {
+   mem_account::MemoryUsage m;
+   mem_report(m);
+   memory_pub.publish(m);
+}
+
 int main(int argc, char ** argv) {
-   goals = new vector<sensor_msgs::NavSatFix>();
+   goals = new goal_vector();
    current_goal = 0;
 
    ros::init(argc, argv, "goal_list");
+   mem_name_tags(mem_tag_names, MEM_TAGS);
 
    ros::NodeHandle n;
 
@@ -181,6 +193,16 @@ int main(int argc, char ** argv) {
    goal_pub = n.advertise<geometry_msgs::PointStamped>("current_goal", 10);
    goal_update_pub = n.advertise<dagny_driver::Goal>("goal_updates", 10);
 
+   // memory per subsystem; 0 disables
+   double memory_rate = 0.2;
+   n.getParam("memory_rate", memory_rate);
+   ros::Timer memory_timer;
+   if( memory_rate > 0 ) {
+      memory_pub = n.advertise<mem_account::MemoryUsage>("memory_usage", 1);
+      memory_timer = n.createTimer(ros::Duration(1.0 / memory_rate),
+            memoryCb);
+   }
+
    ROS_INFO("Goal List ready");
 
    ros::spin();
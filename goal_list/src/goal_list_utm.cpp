@@ -39,11 +39,13 @@
 
 #include <nav_msgs/Odometry.h>
 
+#include <goal_list/goals.h>
 #include <goal_list/gps.h>
+#include <mem_account/mem_report.h>
 
 using namespace std;
 
-vector<sensor_msgs::NavSatFix> * goals;
+goal_vector * goals;
 unsigned int current_goal;
 
 bool loop = false;
@@ -118,7 +120,7 @@ void goalInputCallback(const dagny_driver::Goal::ConstPtr & goal) {
 
             ROS_INFO("Removing goal at %d", goal->id);
 
-            vector<sensor_msgs::NavSatFix>::iterator itr = goals->begin();
+            goal_vector::iterator itr = goals->begin();
             goals->erase(itr + id);
             if( current_goal == id ) {
                publishGoal();
@@ -140,11 +142,21 @@ void goalInputCallback(const dagny_driver::Goal::ConstPtr & goal) {
    }
 }
 
+// memory held by the goal list; see goals.h
+ros::Publisher memory_pub;
+
+void memoryCb(const ros::TimerEvent &) {
+   mem_account::MemoryUsage m;
+   mem_report(m);
+   memory_pub.publish(m);
+}
+
 int main(int argc, char ** argv) {
-   goals = new vector<sensor_msgs::NavSatFix>();
+   goals = new goal_vector();
    current_goal = 0;
 
    ros::init(argc, argv, "goal_list");
+   mem_name_tags(mem_tag_names, MEM_TAGS);
 
    ros::NodeHandle n;
 
@@ -191,6 +203,16 @@ int main(int argc, char ** argv) {
 
    if( active ) publishGoal();
 
+   // memory per subsystem; 0 disables
+   double memory_rate = 0.2;
+   n.getParam("memory_rate", memory_rate);
+   ros::Timer memory_timer;
+   if( memory_rate > 0 ) {
+      memory_pub = n.advertise<mem_account::MemoryUsage>("memory_usage", 1);
+      memory_timer = n.createTimer(ros::Duration(1.0 / memory_rate),
+            memoryCb);
+   }
+
    ROS_INFO("Goal List ready");
 
    ros::spin();
@@ -0,0 +1,122 @@
+/* mem_account.h
+ *
+ * Memory accounting per subsystem, shared by every node that uses it.
+ *
+ * A node numbers its subsystems' tags from 0, below MEM_MAX_TAGS, names
+ * them once at startup, and counts each subsystem's allocations against
+ * its tag: its containers through tagged_allocator, page allocations by
+ * hand, and code it can't hand an allocator to, like a library's, with a
+ * mem_scope (see mem_global_new.h). The counters are atomics, so any
+ * thread may allocate, and cheap enough to leave on; a steady climb in a
+ * tag's allocation count is an allocation made per message or per cycle
+ * that ought to be reused.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_MEM_ACCOUNT_MEM_ACCOUNT_H
+#define DAGNY_MEM_ACCOUNT_MEM_ACCOUNT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+
+#define MEM_MAX_TAGS 16
+
+struct mem_usage {
+   uint64_t bytes;        // held now
+   uint64_t peak;         // most ever held at once
+   uint64_t allocations;  // ever made
+   uint64_t frees;        // ever made
+};
+
+void mem_allocated(int tag, size_t bytes);
+void mem_freed(int tag, size_t bytes);
+
+// a snapshot of tag's counters. each is read atomically, but not all of
+//  them together
+mem_usage mem_read(int tag);
+
+// name tags 0..count-1, for reports. names must outlive the node
+void mem_name_tags(const char * const * names, int count);
+// the number of tags named
+int mem_tags();
+const char * mem_tag_name(int tag);
+
+// resident set of the whole process, accounted for or not. 0 if unknown
+uint64_t mem_resident();
+
+// while one is in scope, allocations this thread makes through the global
+//  operator new are counted against tag. scopes nest. only counts in a
+//  node that includes mem_global_new.h; elsewhere it does nothing
+class mem_scope {
+   public:
+      explicit mem_scope(int tag);
+      ~mem_scope();
+
+      // the tag this thread is allocating against; -1 for none
+      static int current();
+
+   private:
+      int previous_;
+
+      // not copyable
+      mem_scope(const mem_scope &);
+      mem_scope & operator=(const mem_scope &);
+};
+
+// a standard allocator that counts what it allocates against Tag
+template<class T, int Tag>
+class tagged_allocator {
+   public:
+      typedef T value_type;
+      typedef T * pointer;
+      typedef const T * const_pointer;
+      typedef T & reference;
+      typedef const T & const_reference;
+      typedef size_t size_type;
+      typedef ptrdiff_t difference_type;
+
+      template<class U>
+      struct rebind {
+         typedef tagged_allocator<U, Tag> other;
+      };
+
+      tagged_allocator() {}
+      template<class U>
+      tagged_allocator(const tagged_allocator<U, Tag> &) {}
+
+      pointer address(reference x) const { return &x; }
+      const_pointer address(const_reference x) const { return &x; }
+
+      pointer allocate(size_type n, const void * = 0) {
+         pointer p = static_cast<pointer>(::operator new(n * sizeof(T)));
+         mem_allocated(Tag, n * sizeof(T));
+         return p;
+      }
+
+      void deallocate(pointer p, size_type n) {
+         mem_freed(Tag, n * sizeof(T));
+         ::operator delete(p);
+      }
+
+      size_type max_size() const { return size_t(-1) / sizeof(T); }
+
+      void construct(pointer p, const T & v) { new((void*)p) T(v); }
+      void destroy(pointer p) { p->~T(); }
+};
+
+template<class T, class U, int Tag>
+bool operator==(const tagged_allocator<T, Tag> &,
+      const tagged_allocator<U, Tag> &) {
+   return true;
+}
+
+template<class T, class U, int Tag>
+bool operator!=(const tagged_allocator<T, Tag> &,
+      const tagged_allocator<U, Tag> &) {
+   return false;
+}
+
+#endif
@@ -0,0 +1,122 @@
+/* mem_global_new.h
+ *
+ * Replaces the global operator new and delete with ones that count each
+ * allocation against the mem_scope it was made in, so memory allocated
+ * inside a library (a tf buffer, say) can be accounted for. Include it in
+ * exactly one source file of a node that wants that; a node that doesn't
+ * include it keeps the standard allocator, and its mem_scopes do nothing.
+ *
+ * Every allocation carries a small header noting its tag and size, so it
+ * is freed against the tag it was allocated under whichever thread frees
+ * it. Allocations outside any scope aren't counted.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_MEM_ACCOUNT_MEM_GLOBAL_NEW_H
+#define DAGNY_MEM_ACCOUNT_MEM_GLOBAL_NEW_H
+
+#include <stdlib.h>
+
+#include <new>
+
+#include <mem_account/mem_account.h>
+
+// the exception specifications the standard gives these, in either dialect
+#if __cplusplus >= 201103L
+#define MEM_NEW_THROWS
+#define MEM_NEW_NOTHROW noexcept
+#else
+#define MEM_NEW_THROWS throw(std::bad_alloc)
+#define MEM_NEW_NOTHROW throw()
+#ifdef __cpp_sized_deallocation
+void operator delete(void * p, size_t) MEM_NEW_NOTHROW {
+   mem_global_new::release(p);
+}
+
+void operator delete[](void * p, size_t) MEM_NEW_NOTHROW {
+   mem_global_new::release(p);
+}
+#endif
+
+#endif
+
+namespace mem_global_new {
+
+// ahead of every allocation; 16 bytes keeps what follows as aligned as
+//  malloc made it
+union header {
+   struct {
+      size_t bytes;
+      int tag;
+   } h;
+   char pad[16];
+};
+
+inline void * allocate(size_t n) {
+   header * p = (header*)malloc(sizeof(header) + n);
+   if( !p ) return 0;
+   p->h.bytes = n;
+   p->h.tag = mem_scope::current();
+   if( p->h.tag >= 0 ) mem_allocated(p->h.tag, n);
+   return p + 1;
+}
+
+// not inlined into callers, where the compiler would see free() given
+//  what it thinks came from new
+__attribute__((noinline)) inline void release(void * q) {
+   if( !q ) return;
+   header * p = (header*)q - 1;
+   if( p->h.tag >= 0 ) mem_freed(p->h.tag, p->h.bytes);
+   free(p);
+}
+
+}
+
+void * operator new(size_t n) MEM_NEW_THROWS {
+   void * p = mem_global_new::allocate(n);
+   if( !p ) throw std::bad_alloc();
+   return p;
+}
+
+void * operator new[](size_t n) MEM_NEW_THROWS {
+   void * p = mem_global_new::allocate(n);
+   if( !p ) throw std::bad_alloc();
+   return p;
+}
+
+void * operator new(size_t n, const std::nothrow_t &) MEM_NEW_NOTHROW {
+   return mem_global_new::allocate(n);
+}
+
+void * operator new[](size_t n, const std::nothrow_t &) MEM_NEW_NOTHROW {
+   return mem_global_new::allocate(n);
+}
+
+void operator delete(void * p) MEM_NEW_NOTHROW {
+   mem_global_new::release(p);
+}
+
+void operator delete[](void * p) MEM_NEW_NOTHROW {
+   mem_global_new::release(p);
+}
+
+void operator delete(void * p, const std::nothrow_t &) MEM_NEW_NOTHROW {
+   mem_global_new::release(p);
+}
+
+void operator delete[](void * p, const std::nothrow_t &) MEM_NEW_NOTHROW {
+   mem_global_new::release(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void * p, size_t) MEM_NEW_NOTHROW {
+   mem_global_new::release(p);
+}
+
+void operator delete[](void * p, size_t) MEM_NEW_NOTHROW {
+   mem_global_new::release(p);
+}
+#endif
+
+#endif
@@ -0,0 +1,35 @@
+/* mem_report.h
+ *
+ * Fills a MemoryUsage message from the counters of every named tag; see
+ * mem_account.h.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_MEM_ACCOUNT_MEM_REPORT_H
+#define DAGNY_MEM_ACCOUNT_MEM_REPORT_H
+
+#include <ros/ros.h>
+
+#include <mem_account/MemoryUsage.h>
+#include <mem_account/mem_account.h>
+
+inline void mem_report(mem_account::MemoryUsage & m) {
+   m.header.stamp = ros::Time::now();
+   m.tag.clear();
+   m.bytes.clear();
+   m.peak_bytes.clear();
+   m.allocations.clear();
+   m.frees.clear();
+   for( int t=0; t<mem_tags(); t++ ) {
+      mem_usage u = mem_read(t);
+      m.tag.push_back(mem_tag_name(t));
+      m.bytes.push_back(u.bytes);
+      m.peak_bytes.push_back(u.peak);
+      m.allocations.push_back(u.allocations);
+      m.frees.push_back(u.frees);
+   }
+   m.resident_bytes = mem_resident();
+}
+
+#endif
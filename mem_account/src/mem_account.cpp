@@ -0,0 +1,107 @@
+/* mem_account.cpp
+ *
+ * Memory accounting per subsystem.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <boost/atomic.hpp>
+
+#include <mem_account/mem_account.h>
+
+namespace {
+
+struct mem_counters {
+   boost::atomic<uint64_t> bytes;
+   boost::atomic<uint64_t> peak;
+   boost::atomic<uint64_t> allocations;
+   boost::atomic<uint64_t> frees;
+};
+
+// zero-initialized before any constructor runs, so allocations made while
+//  other globals are being constructed are counted too
+mem_counters counters[MEM_MAX_TAGS];
+
+const char * const * tag_names = 0;
+int tag_count = 0;
+
+// the innermost mem_scope of each thread. a plain __thread int needs no
+//  constructor, so the global operator new can read it from any thread at
+//  any time
+__thread int scope_tag = -1;
+
+}
+
+void mem_allocated(int tag, size_t bytes) {
+   if( tag < 0 || tag >= MEM_MAX_TAGS ) return;
+   mem_counters & c = counters[tag];
+   uint64_t now = c.bytes.fetch_add(bytes, boost::memory_order_relaxed) +
+      bytes;
+   uint64_t peak = c.peak.load(boost::memory_order_relaxed);
+   while( now > peak && !c.peak.compare_exchange_weak(peak, now,
+            boost::memory_order_relaxed) ) {
+   }
+   c.allocations.fetch_add(1, boost::memory_order_relaxed);
+}
+
+void mem_freed(int tag, size_t bytes) {
+   if( tag < 0 || tag >= MEM_MAX_TAGS ) return;
+   mem_counters & c = counters[tag];
+   c.bytes.fetch_sub(bytes, boost::memory_order_relaxed);
+   c.frees.fetch_add(1, boost::memory_order_relaxed);
+}
+
+mem_usage mem_read(int tag) {
+   mem_usage u = { 0, 0, 0, 0 };
+   if( tag < 0 || tag >= MEM_MAX_TAGS ) return u;
+   const mem_counters & c = counters[tag];
+   u.bytes = c.bytes.load(boost::memory_order_relaxed);
+   u.peak = c.peak.load(boost::memory_order_relaxed);
+   u.allocations = c.allocations.load(boost::memory_order_relaxed);
+   u.frees = c.frees.load(boost::memory_order_relaxed);
+   return u;
+}
+
+void mem_name_tags(const char * const * names, int count) {
+   tag_names = names;
+   tag_count = count < MEM_MAX_TAGS ? count : MEM_MAX_TAGS;
+}
+
+int mem_tags() {
+   return tag_count;
+}
+
+const char * mem_tag_name(int tag) {
+   if( tag < 0 || tag >= tag_count ) return "?";
+   return tag_names[tag];
+}
+
+uint64_t mem_resident() {
+   // the second field of statm is the resident set, in pages
+   uint64_t bytes = 0;
+   FILE * statm = fopen("/proc/self/statm", "r");
+   if( statm ) {
+      unsigned long size;
+      unsigned long resident;
+      if( fscanf(statm, "%lu %lu", &size, &resident) == 2 ) {
+         bytes = (uint64_t)resident * sysconf(_SC_PAGESIZE);
+      }
+      fclose(statm);
+   }
+   return bytes;
+}
+
+mem_scope::mem_scope(int tag) : previous_(scope_tag) {
+   scope_tag = tag;
+}
+
+mem_scope::~mem_scope() {
+   scope_tag = previous_;
+}
+
+int mem_scope::current() {
+   return scope_tag;
+}
@@ -0,0 +1,85 @@
+/* byte_io.h
+ *
+ * Little-endian fields in byte buffers, for the formats the map is sent
+ * to other machines in.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_BYTE_IO_H
+#define DAGNY_BYTE_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+inline void put_u16(std::vector<uint8_t> & out, uint16_t v) {
+   out.push_back(v);
+   out.push_back(v >> 8);
+}
+
+inline void put_u32(std::vector<uint8_t> & out, uint32_t v) {
+   for( int k=0; k<4; k++ ) out.push_back(v >> (8*k));
+}
+
+inline void put_f32(std::vector<uint8_t> & out, float f) {
+   uint32_t v;
+   memcpy(&v, &f, sizeof(v));
+   put_u32(out, v);
+}
+
+inline void put_f64(std::vector<uint8_t> & out, double f) {
+   uint64_t v;
+   memcpy(&v, &f, sizeof(v));
+   put_u32(out, v);
+   put_u32(out, v >> 32);
+}
+
+// reads little-endian fields from a buffer, and notes if it runs off the
+//  end; everything read after that is 0
+class byte_reader {
+   public:
+      byte_reader(const uint8_t * data, size_t bytes) : p_(data),
+         end_(data + bytes), ok_(true) {}
+
+      bool ok() const { return ok_; }
+      const uint8_t * here() const { return p_; }
+
+      bool skip(size_t n) {
+         if( !ok_ || (size_t)(end_ - p_) < n ) ok_ = false;
+         else p_ += n;
+         return ok_;
+      }
+
+      // an unsigned field of 1 to 4 bytes
+      uint32_t u(int bytes) {
+         uint32_t v = 0;
+         if( !skip(bytes) ) return 0;
+         for( int k=0; k<bytes; k++ ) v |= (uint32_t)p_[k - bytes] << (8*k);
+         return v;
+      }
+
+      float f32() {
+         uint32_t v = u(4);
+         float f;
+         memcpy(&f, &v, sizeof(f));
+         return f;
+      }
+
+      double f64() {
+         uint64_t v = u(4);
+         v |= (uint64_t)u(4) << 32;
+         double f;
+         memcpy(&f, &v, sizeof(f));
+         return f;
+      }
+
+   private:
+      const uint8_t * p_;
+      const uint8_t * end_;
+      bool ok_;
+};
+
+#endif
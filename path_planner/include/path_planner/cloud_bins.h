@@ -0,0 +1,74 @@
+/* cloud_bins.h
+ *
+ * Downsample a raw PointCloud2 buffer into 2D map cells.
+ *
+ * Points are read straight out of the message's byte buffer, transformed
+ * into the map frame, filtered by height and dropped into a grid of bins.
+ * Each bin remembers only whether it saw an obstacle or just floor, so a
+ * dense cloud collapses to at most one raytrace per map cell.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_CLOUD_BINS_H
+#define DAGNY_CLOUD_BINS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+// where to find the x, y and z coordinates (FLOAT32) in a point cloud
+struct cloud_layout {
+   size_t width;
+   size_t height;
+   size_t point_step;
+   size_t row_step;
+   uint32_t x_offset;
+   uint32_t y_offset;
+   uint32_t z_offset;
+};
+
+// rigid transform from the cloud frame to the map frame
+//  rotation r is row-major
+struct cloud_transform {
+   double r[9];
+   double t[3];
+};
+
+class CloudBins {
+   public:
+      enum {
+         EMPTY = 0,
+         FLOOR = 1,    // only seen ground; free space up to here
+         OBSTACLE = 2  // saw something between min_z and max_z
+      };
+
+      // size x size bins of res meters each
+      CloudBins(int size, double res);
+
+      // bin every point in data. the bins are centered on
+      //  (center_x, center_y) in the map frame, and use the same cell
+      //  rounding as the local map. points between min_z and max_z are
+      //  obstacles, points below min_z are floor, points above max_z and
+      //  NaNs are dropped. returns the number of points that landed in a bin
+      size_t bin(const uint8_t * data, const cloud_layout & layout,
+            const cloud_transform & tf, double center_x, double center_y,
+            double min_z, double max_z);
+
+      // indices (i*size + j) of every non-empty bin, in the order first seen
+      const std::vector<int> & cells() const { return cells_; }
+
+      uint8_t at(int cell) const { return bins_[cell]; }
+
+      // reset the bins touched since the last clear
+      void clear();
+
+   private:
+      int size_;
+      double res_;
+      std::vector<uint8_t> bins_;
+      std::vector<int> cells_;
+};
+
+#endif
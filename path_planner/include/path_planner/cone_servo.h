@@ -0,0 +1,99 @@
+/* cone_servo.h
+ *
+ * Steering toward a cone from camera bearings and laser cone candidates.
+ *
+ * A camera bearing is stale by the time it arrives, and the robot has
+ * usually turned since the frame was taken. Each bearing is kept in the
+ * odometry frame, as the heading it was seen at from the pose the robot
+ * had when the frame was taken, so it can be rotated into the current
+ * frame when steering. Laser candidates that lie along a recent bearing
+ * confirm it and give the cone a position; while the cone has one, the
+ * robot steers the pure-pursuit arc through it, which is stable at any
+ * speed, rather than turning in proportion to the bearing.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_CONE_SERVO_H
+#define DAGNY_CONE_SERVO_H
+
+#include <math.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include <path_planner/odom_history.h>
+
+class ConeServo {
+   public:
+      // bearings are placed with poses from odom
+      explicit ConeServo(const OdomHistory & odom);
+
+      // gain: turn rate (rad/s) per radian of bearing, when steering by
+      //  bearing alone. gate: how far (rad) a laser candidate may be from
+      //  the camera bearing, or (m) from the cone's last position.
+      //  timeout: how long (s) a bearing or a position is steered by
+      void set_params(double gain, double gate, double timeout);
+
+      // the camera saw the cone bearing radians left of the robot's
+      //  heading, in a frame taken at stamp
+      void vision(double stamp, double bearing);
+
+      // cone candidates from the laser, in the odometry frame, seen at
+      //  stamp. P is anything with x and y members, such as
+      //  geometry_msgs::Point, so a message's points can be passed as they
+      //  are
+      template<class P>
+      void laser(double stamp, const std::vector<P> & points);
+
+      // curvature (1/m, left positive) to steer at speed, from pose now.
+      //  false if no cone has been seen within the timeout
+      bool steer(const odom_pose & now, double speed, double & curvature);
+
+      // the cone's position in the odometry frame; false if it has none
+      bool position(double now, double & x, double & y) const;
+
+   private:
+      // how well the candidate at (x, y) matches what is known of the
+      //  cone: smaller is better, and negative if it doesn't match at all
+      double match(double stamp, double x, double y) const;
+
+      // move the cone to (x, y)
+      void fix(double stamp, double x, double y);
+
+      const OdomHistory & odom_;
+      double gain_;
+      double gate_;
+      double timeout_;
+
+      // the last camera bearing, as a heading from the pose it was seen at
+      bool have_bearing_;
+      odom_pose seen_;
+      double heading_;
+
+      // the cone's position, from laser candidates that matched
+      bool have_fix_;
+      double fix_stamp_;
+      double fix_x_;
+      double fix_y_;
+
+      // not copyable
+      ConeServo(const ConeServo &);
+      ConeServo & operator=(const ConeServo &);
+};
+
+template<class P>
+void ConeServo::laser(double stamp, const std::vector<P> & points) {
+   double best = -1.0;
+   size_t k = 0;
+   for( size_t i=0; i<points.size(); i++ ) {
+      double m = match(stamp, points[i].x, points[i].y);
+      if( m >= 0.0 && (best < 0.0 || m < best) ) {
+         best = m;
+         k = i;
+      }
+   }
+   if( best >= 0.0 ) fix(stamp, points[k].x, points[k].y);
+}
+
+#endif
@@ -0,0 +1,175 @@
+/* costmap_layer.h
+ *
+ * Interface for one layer of the layered obstacle map.
+ *
+ * Each layer keeps its own state (raw obstacle evidence, keepout zones,
+ * the robot's footprint, ...) and contributes costs to the master grid
+ * that collision checks read. When a layer changes it reports the tiles
+ * it touched; the map then asks every layer, in order, which tiles that
+ * reaches (inflation spreads it, for instance), and recomposites only
+ * those.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_COSTMAP_LAYER_H
+#define DAGNY_COSTMAP_LAYER_H
+
+#include <algorithm>
+#include <vector>
+
+#include <path_planner/obstacle_map.h>
+
+// master grid costs. the planner treats anything non-zero as an obstacle;
+//  where layers overlap, the highest cost wins
+#define COST_FREE 0
+#define COST_INFLATED 1
+#define COST_OBSTACLE 2
+#define COST_KEEPOUT 3
+
+// inclusive range of map cells, (i0..i1, j0..j1)
+struct cell_bounds {
+   int i0;
+   int j0;
+   int i1;
+   int j1;
+
+   // empty
+   cell_bounds() : i0(1 << 30), j0(1 << 30), i1(-(1 << 30)),
+      j1(-(1 << 30)) {}
+   cell_bounds(int _i0, int _j0, int _i1, int _j1) : i0(_i0), j0(_j0),
+      i1(_i1), j1(_j1) {}
+
+   bool empty() const { return i0 > i1 || j0 > j1; }
+
+   void include(int i, int j) {
+      i0 = std::min(i0, i);
+      j0 = std::min(j0, j);
+      i1 = std::max(i1, i);
+      j1 = std::max(j1, j);
+   }
+
+   void include(const cell_bounds & b) {
+      if( b.empty() ) return;
+      include(b.i0, b.j0);
+      include(b.i1, b.j1);
+   }
+
+   // grow by r cells on every side
+   void grow(int r) {
+      if( empty() ) return;
+      i0 -= r;
+      j0 -= r;
+      i1 += r;
+      j1 += r;
+   }
+
+   // clip to a size x size map
+   void clip(int size) {
+      i0 = std::max(i0, 0);
+      j0 = std::max(j0, 0);
+      i1 = std::min(i1, size - 1);
+      j1 = std::min(j1, size - 1);
+   }
+};
+
+// the map tiles, MAP_TILE cells square, that hold changed cells, for an
+//  N x N map. a set of tiles rather than one bounding box, so changes at
+//  opposite ends of the map don't drag everything between them into the
+//  recomposite
+template<int N>
+class dirty_tiles {
+   public:
+      enum {
+         BITS = MAP_TILE_BITS,
+         TILES = (N + (1 << BITS) - 1) >> BITS
+      };
+
+      dirty_tiles() : marked_(TILES * TILES, 0) {}
+
+      bool empty() const { return tiles_.empty(); }
+
+      // the tile holding cell (i, j); cells off the map are ignored
+      void include(int i, int j) {
+         if( i < 0 || j < 0 || i >= N || j >= N ) return;
+         mark((i >> BITS) * TILES + (j >> BITS));
+      }
+
+      // every tile b overlaps
+      void include(cell_bounds b) {
+         b.clip(N);
+         if( b.empty() ) return;
+         for( int ti = b.i0 >> BITS; ti <= b.i1 >> BITS; ti++ ) {
+            for( int tj = b.j0 >> BITS; tj <= b.j1 >> BITS; tj++ ) {
+               mark(ti * TILES + tj);
+            }
+         }
+      }
+
+      void include(const dirty_tiles & d) {
+         for( size_t k=0; k<d.tiles_.size(); k++ ) mark(d.tiles_[k]);
+      }
+
+      void clear() {
+         for( size_t k=0; k<tiles_.size(); k++ ) marked_[tiles_[k]] = 0;
+         tiles_.clear();
+      }
+
+      // the marked tiles as cells, one rectangle per run of adjacent tiles
+      //  along a row of tiles, clipped to the map. out is cleared first
+      void runs(std::vector<cell_bounds> & out) {
+         out.clear();
+         std::sort(tiles_.begin(), tiles_.end());
+         for( size_t k=0; k<tiles_.size(); ) {
+            size_t e = k + 1;
+            while( e < tiles_.size() && tiles_[e] == tiles_[e - 1] + 1 &&
+                  tiles_[e] % TILES != 0 ) {
+               ++e;
+            }
+            const int ti = tiles_[k] / TILES;
+            cell_bounds b(ti << BITS, (tiles_[k] % TILES) << BITS,
+                  ((ti + 1) << BITS) - 1,
+                  ((tiles_[e - 1] % TILES + 1) << BITS) - 1);
+            b.clip(N);
+            out.push_back(b);
+            k = e;
+         }
+      }
+
+   private:
+      void mark(int t) {
+         if( marked_[t] ) return;
+         marked_[t] = 1;
+         tiles_.push_back(t);
+      }
+
+      std::vector<uint8_t> marked_;
+      // the marked tiles, in the order they were marked
+      std::vector<int> tiles_;
+};
+
+// a cell that became occupied, or stopped being occupied
+struct cell_flip {
+   int i;
+   int j;
+   bool occupied;
+};
+
+template<class G, class Layout>
+class CostmapLayer {
+   public:
+      virtual ~CostmapLayer() {}
+
+      // add to d every tile holding a cell whose cost this layer will
+      //  change. d arrives holding the tiles that changed in the layers
+      //  before this one; the layer adds whatever it changed itself since
+      //  the last update
+      virtual void update_bounds(dirty_tiles<G::size> & d) = 0;
+
+      // write this layer's costs for the cells in b into master. master
+      //  already holds the costs of the layers before this one. called
+      //  once for each run of dirty tiles
+      virtual void update_costs(map_type * master, const cell_bounds & b) = 0;
+};
+
+#endif
@@ -0,0 +1,79 @@
+/* footprint_layer.h
+ *
+ * Costmap layer that keeps the robot's own footprint clear, so the robot
+ * never finds itself starting inside an obstacle.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_FOOTPRINT_LAYER_H
+#define DAGNY_FOOTPRINT_LAYER_H
+
+#include <math.h>
+
+#include <utility>
+#include <vector>
+
+#include <path_planner/costmap_layer.h>
+#include <path_planner/grid.h>
+
+template<class G, class Layout>
+class FootprintLayer : public CostmapLayer<G, Layout> {
+   public:
+      FootprintLayer() {}
+
+      // move the footprint to a robot at (x, y, theta)
+      void set(double x, double y, double theta);
+
+      // map cells under the footprint
+      const std::vector<std::pair<int, int> > & cells() const {
+         return cells_;
+      }
+
+      virtual void update_bounds(dirty_tiles<G::size> & d) {
+         d.include(changed_);
+         changed_.clear();
+      }
+
+      virtual void update_costs(map_type * master, const cell_bounds & b) {
+         for( size_t k=0; k<cells_.size(); k++ ) {
+            int i = cells_[k].first;
+            int j = cells_[k].second;
+            if( i >= b.i0 && i <= b.i1 && j >= b.j0 && j <= b.j1 ) {
+               master[Layout::index(i, j)] = COST_FREE;
+            }
+         }
+      }
+
+   private:
+      std::vector<std::pair<int, int> > cells_;
+      // tiles under the old and new footprint since the last update
+      dirty_tiles<G::size> changed_;
+};
+
+template<class G, class Layout>
+void FootprintLayer<G, Layout>::set(double x, double y, double theta) {
+   for( size_t k=0; k<cells_.size(); k++ ) {
+      changed_.include(cells_[k].first, cells_[k].second);
+   }
+   cells_.clear();
+
+   // base footprint: 0.32m wide, from 0.17m behind the base to 0.45m
+   //  ahead of it, sampled every half cell
+   const double step = G::res() / 2.0;
+   const double c = cos(theta);
+   const double s = sin(theta);
+   for( double side = -0.16; side <= 0.16; side += step ) {
+      for( double fwd = -0.17; fwd < 0.45; fwd += step ) {
+         int i = fixed_cell(G::fixed(x + fwd*c - side*s));
+         int j = fixed_cell(G::fixed(y + fwd*s + side*c));
+         if( cells_.empty() || cells_.back().first != i ||
+               cells_.back().second != j ) {
+            cells_.push_back(std::make_pair(i, j));
+            changed_.include(i, j);
+         }
+      }
+   }
+}
+
+#endif
@@ -0,0 +1,63 @@
+/* grid.h
+ *
+ * Compile-time grid geometry and fixed-point cell coordinates.
+ *
+ * Map coordinates are carried as Q16.16 fixed-point cell indices: the
+ * integer part is the cell, the fraction is the position within it. A pose
+ * is converted once, and from there the hot loops step and round with
+ * integer adds and shifts instead of divide-round-convert on every access.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_GRID_H
+#define DAGNY_GRID_H
+
+#include <stdint.h>
+
+// Q16.16 fixed point
+typedef int32_t fixed_t;
+
+#define FIXED_SHIFT 16
+#define FIXED_ONE (1 << FIXED_SHIFT)
+#define FIXED_HALF (1 << (FIXED_SHIFT - 1))
+
+// convert a value in cells to fixed point. truncates, which is well below
+//  the resolution we care about; clamps so far-off points stay far off
+//  instead of overflowing
+inline fixed_t to_fixed(double cells) {
+   double f = cells * FIXED_ONE;
+   if( f > (double)(1 << 30) ) return 1 << 30;
+   if( f < -(double)(1 << 30) ) return -(1 << 30);
+   return (fixed_t)f;
+}
+
+// index of the cell containing a fixed-point coordinate.
+//  cell i spans [i - 0.5, i + 0.5)
+inline int fixed_cell(fixed_t f) {
+   return (f + FIXED_HALF) >> FIXED_SHIFT;
+}
+
+// map geometry: SIZE x SIZE cells of RES_MM millimeters each, centered on
+//  the origin
+template<int SIZE, int RES_MM>
+struct grid_geometry {
+   enum {
+      size = SIZE,
+      res_mm = RES_MM
+   };
+
+   static double res() { return RES_MM / 1000.0; }
+
+   // fixed-point cell coordinate of a world coordinate (m)
+   static fixed_t fixed(double x) {
+      return to_fixed(x * (1000.0 / RES_MM)) + (SIZE / 2) * FIXED_ONE;
+   }
+
+   // world coordinate (m) of the center of cell i
+   static double world(int i) {
+      return (i - SIZE / 2) * res();
+   }
+};
+
+#endif
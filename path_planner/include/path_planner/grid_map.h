@@ -0,0 +1,691 @@
+/* grid_map.h
+ *
+ * ObstacleMap implementation for a compile-time grid geometry.
+ *
+ * Every world coordinate is converted to fixed-point cells once on the way
+ * in; arcs are walked by rotating a fixed-point offset vector, and rays by
+ * integer DDA, so the inner loops have no divides, no rounding calls and no
+ * trig.
+ *
+ * The cell buffer is stored in the order given by the Layout policy; see
+ * map_layout.h.
+ *
+ * The cells the planner reads are a master grid composited from a stack of
+ * costmap layers: raw obstacle evidence, its inflation, static keepout
+ * zones, and the robot's footprint. Layers report the tiles they changed
+ * and only those tiles are recomposited, so the cost of an update is set
+ * by what changed rather than by how many layers there are, or how far
+ * apart the changes are.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_GRID_MAP_H
+#define DAGNY_GRID_MAP_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#include <path_planner/costmap_layer.h>
+#include <path_planner/footprint_layer.h>
+#include <path_planner/grid.h>
+#include <path_planner/inflation_layer.h>
+#include <path_planner/keepout.h>
+#include <path_planner/map_alloc.h>
+#include <path_planner/map_layout.h>
+#include <path_planner/map_pyramid.h>
+#include <path_planner/mem_account.h>
+#include <path_planner/obstacle_layer.h>
+#include <path_planner/obstacle_map.h>
+#include <path_planner/static_layer.h>
+#include <path_planner/worker_pool.h>
+
+// obstacles are grown by this much (m) so the planner can treat the robot
+//  as a point
+#define INFLATION_RADIUS 0.3
+
+template<class G, class Layout = typename default_layout<G::size>::type>
+class GridMap : public ObstacleMap {
+   public:
+      GridMap(map_pages pages = PAGES_DEFAULT, int numa_node = -1,
+            int local_size = LOCAL_MAP_SIZE);
+      virtual ~GridMap();
+
+      virtual int size() const { return G::size; }
+      virtual double resolution() const { return G::res(); }
+      virtual int local_size() const { return local_size_; }
+      virtual map_pages pages() const { return alloc_.pages; }
+
+      virtual map_type get(double x, double y) {
+         return get_cell(fixed_cell(G::fixed(x)), fixed_cell(G::fixed(y)));
+      }
+      virtual void set(double x, double y, map_type v) {
+         set_cell(fixed_cell(G::fixed(x)), fixed_cell(G::fixed(y)), v);
+      }
+      virtual void set(const std::vector<double> & x,
+            const std::vector<double> & y,
+            const std::vector<map_type> & v);
+
+      virtual bool test_arc(double x, double y, double theta,
+            double r, double l);
+      virtual double raycast(double x, double y, double theta,
+            double range);
+
+      virtual uint32_t stamp() const { return stamp_; }
+      virtual bool arc_changed(double x, double y, double theta,
+            double r, double l, uint32_t since) const;
+      virtual uint32_t tile_stamp(int ti, int tj) const {
+         return tile_stamp_[ti * STAMP_TILES + tj];
+      }
+      virtual void read_tile(int ti, int tj, map_type * out);
+
+      virtual void advance_epoch();
+      virtual bool catch_up(int tiles);
+
+      virtual map_type evidence(double x, double y) const {
+         const int i = fixed_cell(G::fixed(x));
+         const int j = fixed_cell(G::fixed(y));
+         if( i >= 0 && i < N && j >= 0 && j < N ) {
+            return obstacles_.peek(i, j);
+         }
+         return 0;
+      }
+      virtual bool evidence_bounds(double & x0, double & y0,
+            double & x1, double & y1) const;
+      virtual void resample(const ObstacleMap & from, int i0, int i1);
+
+      virtual void read_window(double x, double y, int size, map_type * out,
+            double & cx, double & cy);
+
+      virtual void add_keepout(const std::vector<double> & x,
+            const std::vector<double> & y);
+      virtual void clear_keepout() {
+         keepout_.clear();
+         composite();
+      }
+
+      virtual void prefault(double x, double y, double r);
+
+      virtual void local_clear(double x, double y);
+      virtual void local_center(double & x, double & y) const;
+      virtual void local_raytrace(double x, double y, double c, double s,
+            double r);
+      virtual void local_raytrace(const local_rays & rays,
+            WorkerPool * pool);
+      virtual void local_mark(double x, double y);
+      virtual void local_merge(double x, double y, double theta);
+
+      // master cost of cell (i, j); 0 for any cell not within the map
+      map_type get_cell(int i, int j) {
+         if( i >= 0 && i < N && j >= 0 && j < N ) {
+            if( obstacles_.stale(i, j) ) {
+               // catch up on decay before anyone sees the cell
+               obstacles_.touch(i, j);
+               composite();
+            }
+            return data_[Layout::index(i, j)];
+         }
+         return 0;
+      }
+
+      // set the obstacle evidence in cell (i, j)
+      void set_cell(int i, int j, map_type v) {
+         if( i >= 0 && i < N && j >= 0 && j < N ) {
+            obstacles_.set(i, j, v);
+            composite();
+         }
+      }
+
+      // add a layer on top of the stack, below the footprint. the map
+      //  doesn't take ownership
+      void add_layer(CostmapLayer<G, Layout> * layer) {
+         layers_.insert(layers_.end() - 1, layer);
+      }
+
+      // recomposite every cell any layer changed since the last composite
+      void composite();
+
+      ObstacleLayer<G, Layout> & obstacles() { return obstacles_; }
+      StaticLayer<G, Layout> & keepout() { return keepout_; }
+
+   private:
+      // cells of a local map
+      typedef std::vector<map_type, tagged_allocator<map_type, MEM_LOCAL> >
+         local_cells;
+
+      enum {
+         N = G::size,
+         STAMP_BITS = MAP_TILE_BITS,
+         STAMP_TILES = (G::size + (1 << STAMP_BITS) - 1) >> STAMP_BITS
+      };
+
+      // number of half-cell steps we can skip from (u, v) without hitting
+      //  anything; 0 if (u, v) is occupied. any sample closer than the edge
+      //  of the empty pyramid block around (u, v) would land inside that
+      //  block, so skipping it can't miss an obstacle
+      int free_steps(fixed_t u, fixed_t v);
+
+      // mark free space along ray in local, a local map, and add the
+      //  cells marked to touched
+      void trace(map_type * local, const local_ray & ray,
+            cell_bounds & touched) const;
+      // the k'th of n runs of rays, into the k'th thread's local map
+      void trace_part(const local_rays * rays, int n, int k);
+
+      // master grid, and its pyramid
+      map_allocation alloc_;
+      map_type * data_;
+      MapPyramid pyramid_;
+
+      ObstacleLayer<G, Layout> obstacles_;
+      InflationLayer<G, Layout> inflation_;
+      StaticLayer<G, Layout> keepout_;
+      FootprintLayer<G, Layout> footprint_;
+      // compositing order; the footprint is always last
+      std::vector<CostmapLayer<G, Layout> *> layers_;
+
+      // tiles any layer changed, and their runs; kept between composites
+      //  so compositing doesn't allocate
+      dirty_tiles<G::size> dirty_;
+      std::vector<cell_bounds> runs_;
+
+      // bumped by every composite, and recorded in each tile it touched
+      uint32_t stamp_;
+      std::vector<uint32_t, tagged_allocator<uint32_t, MEM_MAP> > tile_stamp_;
+      // the tile of seen() that catch_up carries on from, row-major. kept
+      //  across epochs, so every tile is reached in turn
+      int catch_up_;
+
+      // scratch map for integrating one batch of sensor data before it's
+      //  merged. -1 is free space, 1 is an obstacle, 0 is unknown
+      const int local_size_;
+      local_cells local_;
+      // map cell under the center of the local map
+      int local_i_;
+      int local_j_;
+      // local maps for the second and later raytracing threads, and the
+      //  cells each thread marked; all unknown between uses
+      std::vector<local_cells> thread_local_;
+      std::vector<cell_bounds> thread_touched_;
+
+      // not copyable
+      GridMap(const GridMap &);
+      GridMap & operator=(const GridMap &);
+};
+
+template<class G, class Layout>
+GridMap<G, Layout>::GridMap(map_pages pages, int numa_node, int local_size) :
+   pyramid_(N),
+   obstacles_(pages, numa_node),
+   inflation_(obstacles_, INFLATION_RADIUS, pages, numa_node),
+   keepout_(pages, numa_node), stamp_(0),
+   tile_stamp_(STAMP_TILES * STAMP_TILES), catch_up_(0),
+   local_size_(local_size),
+   local_(local_size * local_size), local_i_(N/2), local_j_(N/2) {
+   map_alloc(Layout::cells * sizeof(map_type), pages, numa_node, alloc_);
+   data_ = (map_type*)alloc_.data;
+
+   layers_.push_back(&obstacles_);
+   layers_.push_back(&inflation_);
+   layers_.push_back(&keepout_);
+   layers_.push_back(&footprint_);
+}
+
+template<class G, class Layout>
+GridMap<G, Layout>::~GridMap() {
+   map_free(alloc_);
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::composite() {
+   for( size_t l=0; l<layers_.size(); l++ ) {
+      layers_[l]->update_bounds(dirty_);
+   }
+   if( dirty_.empty() ) return;
+   dirty_.runs(runs_);
+   dirty_.clear();
+
+   ++stamp_;
+   for( size_t r=0; r<runs_.size(); r++ ) {
+      const cell_bounds & b = runs_[r];
+      for( int i=b.i0; i<=b.i1; i++ ) {
+         for( int j=b.j0; j<=b.j1; j++ ) {
+            data_[Layout::index(i, j)] = COST_FREE;
+         }
+      }
+      for( size_t l=0; l<layers_.size(); l++ ) {
+         layers_[l]->update_costs(data_, b);
+      }
+      pyramid_.template update<Layout>(data_, b.i0, b.j0, b.i1, b.j1);
+
+      for( int ti = b.i0 >> STAMP_BITS; ti <= b.i1 >> STAMP_BITS; ti++ ) {
+         for( int tj = b.j0 >> STAMP_BITS; tj <= b.j1 >> STAMP_BITS;
+               tj++ ) {
+            tile_stamp_[ti * STAMP_TILES + tj] = stamp_;
+         }
+      }
+   }
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::read_window(double x, double y, int size,
+      map_type * out, double & cx, double & cy) {
+   const int ci = fixed_cell(G::fixed(x));
+   const int cj = fixed_cell(G::fixed(y));
+   cx = G::world(ci);
+   cy = G::world(cj);
+   const int i0 = ci - size/2;
+   const int j0 = cj - size/2;
+   for( int i=0; i<size; i++ ) {
+      for( int j=0; j<size; j++ ) {
+         out[i*size + j] = get_cell(i0 + i, j0 + j);
+      }
+   }
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::set(const std::vector<double> & x,
+      const std::vector<double> & y, const std::vector<map_type> & v) {
+   for( size_t k=0; k<v.size(); k++ ) {
+      const int i = fixed_cell(G::fixed(x[k]));
+      const int j = fixed_cell(G::fixed(y[k]));
+      if( i >= 0 && i < N && j >= 0 && j < N ) obstacles_.set(i, j, v[k]);
+   }
+   composite();
+}
+
+template<class G, class Layout>
+bool GridMap<G, Layout>::evidence_bounds(double & x0, double & y0,
+      double & x1, double & y1) const {
+   const cell_bounds & b = obstacles_.seen();
+   if( b.empty() ) return false;
+   x0 = G::world(b.i0);
+   y0 = G::world(b.j0);
+   x1 = G::world(b.i1);
+   y1 = G::world(b.j1);
+   return true;
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::resample(const ObstacleMap & from, int i0,
+      int i1) {
+   double x0, y0, x1, y1;
+   if( !from.evidence_bounds(x0, y0, x1, y1) ) return;
+
+   // sample every source cell center within a cell of ours, edges
+   //  included: k cells wide when we're k times coarser, and just our own
+   //  center when we're finer
+   const double fres = from.resolution();
+   const int k = std::max(1, (int)(G::res() / fres + 0.5)) / 2;
+   cell_bounds b(fixed_cell(G::fixed(x0)) - 1, fixed_cell(G::fixed(y0)) - 1,
+         fixed_cell(G::fixed(x1)) + 1, fixed_cell(G::fixed(y1)) + 1);
+   b.clip(N);
+   b.i0 = std::max(b.i0, i0);
+   b.i1 = std::min(b.i1, i1);
+   if( b.empty() ) return;
+   for( int i=b.i0; i<=b.i1; i++ ) {
+      for( int j=b.j0; j<=b.j1; j++ ) {
+         map_type v = 0;
+         for( int a=-k; a<=k; a++ ) {
+            for( int c=-k; c<=k; c++ ) {
+               v = std::max(v, from.evidence(G::world(i) + a*fres,
+                        G::world(j) + c*fres));
+            }
+         }
+         if( v > 0 ) obstacles_.set(i, j, v);
+      }
+   }
+   composite();
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::add_keepout(const std::vector<double> & x,
+      const std::vector<double> & y) {
+   // fractional cell coordinates; cell centers are on the integers. done
+   //  in floating point since zones may be far off the map
+   std::vector<double> u(x.size());
+   std::vector<double> v(y.size());
+   for( size_t k=0; k<x.size(); k++ ) {
+      u[k] = x[k] / G::res() + N/2;
+      v[k] = y[k] / G::res() + N/2;
+   }
+   std::vector<cell_span> spans;
+   scanline_fill(u, v, N, spans);
+   for( size_t s=0; s<spans.size(); s++ ) {
+      keepout_.fill_span(spans[s].i, spans[s].j0, spans[s].j1);
+   }
+   composite();
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::prefault(double x, double, double r) {
+   // every layout keeps whole rows of cells (or of blocks) contiguous, so
+   //  the full-width band of rows within r of the robot is one range of
+   //  the buffer. y doesn't narrow it down
+   const int cr = ceil(r / G::res());
+   const int i0 = std::max(fixed_cell(G::fixed(x)) - cr, 0);
+   const int i1 = std::min(fixed_cell(G::fixed(x)) + cr, N - 1);
+   if( i0 > i1 ) return;
+   // round out to 4k pages
+   const size_t lo = Layout::row_begin(i0) & ~(size_t)4095;
+   const size_t hi = std::min((Layout::row_end(i1) - 1) | 4095,
+         (size_t)Layout::cells - 1);
+   map_prefault(data_ + lo, hi - lo + 1);
+   map_prefault(obstacles_.data() + lo, hi - lo + 1);
+   map_prefault(inflation_.counts() + lo, (hi - lo + 1) * 2);
+}
+
+template<class G, class Layout>
+int GridMap<G, Layout>::free_steps(fixed_t u, fixed_t v) {
+   fixed_t margin = pyramid_.free_margin(u, v);
+   if( margin > 0 ) {
+      // ceil(margin / half cell), rounded down a hair for safety
+      return std::max(1, (margin + FIXED_HALF - 2) >> (FIXED_SHIFT - 1));
+   }
+   return get_cell(fixed_cell(u), fixed_cell(v)) != 0 ? 0 : 1;
+}
+
+template<class G, class Layout>
+bool GridMap<G, Layout>::test_arc(double x, double y, double theta,
+      double r, double l) {
+   // sample every half cell along the arc
+   const double step = G::res() / 2.0;
+   const int steps = ceil(l / step);
+
+   if( r != 0.0 ) {
+      // normal case; traverse an arc
+      //  walk a fixed-point vector from the center of the arc to the robot,
+      //  rotating it by the arc angle of each skip
+      double phi = theta - M_PI/2;
+      fixed_t cu = G::fixed(x + r * cos(theta + M_PI/2));
+      fixed_t cv = G::fixed(y + r * sin(theta + M_PI/2));
+      int64_t du = to_fixed(r * cos(phi) / G::res());
+      int64_t dv = to_fixed(r * sin(phi) / G::res());
+
+      // rotations by 2^b steps, Q2.30; built by repeated angle doubling
+      int64_t rot_c[16];
+      int64_t rot_s[16];
+      double c = cos(step / r);
+      double s = sin(step / r);
+      for( int b=0; b<16; b++ ) {
+         rot_c[b] = c * (1 << 30);
+         rot_s[b] = s * (1 << 30);
+         double c2 = c*c - s*s;
+         s = 2.0*c*s;
+         c = c2;
+      }
+
+      for( int n = 0; n < steps; ) {
+         int skip = free_steps(cu + du, cv + dv);
+         if( skip == 0 ) {
+            return false;
+         }
+         n += skip;
+         for( int b=0; skip; b++, skip >>= 1 ) {
+            if( skip & 1 ) {
+               int64_t u = (du * rot_c[b] - dv * rot_s[b]) >> 30;
+               dv = (du * rot_s[b] + dv * rot_c[b]) >> 30;
+               du = u;
+            }
+         }
+      }
+   } else {
+      // degenerate case; traverse a line
+      fixed_t u = G::fixed(x);
+      fixed_t v = G::fixed(y);
+      fixed_t du = to_fixed(cos(theta) / 2.0);
+      fixed_t dv = to_fixed(sin(theta) / 2.0);
+      for( int n = 0; n < steps; ) {
+         int skip = free_steps(u + n*du, v + n*dv);
+         if( skip == 0 ) {
+            return false;
+         }
+         n += skip;
+      }
+   }
+   return true;
+}
+
+template<class G, class Layout>
+double GridMap<G, Layout>::raycast(double x, double y, double theta,
+      double range) {
+   // the straight case of test_arc, reporting where it stopped
+   const double step = G::res() / 2.0;
+   const int steps = ceil(range / step);
+   fixed_t u = G::fixed(x);
+   fixed_t v = G::fixed(y);
+   fixed_t du = to_fixed(cos(theta) / 2.0);
+   fixed_t dv = to_fixed(sin(theta) / 2.0);
+   for( int n = 0; n < steps; ) {
+      int skip = free_steps(u + n*du, v + n*dv);
+      if( skip == 0 ) {
+         return n * step;
+      }
+      n += skip;
+   }
+   return range;
+}
+
+template<class G, class Layout>
+bool GridMap<G, Layout>::arc_changed(double x, double y, double theta,
+      double r, double l, uint32_t since) const {
+   // points every STEP cells along the arc, checked against the stamps of
+   //  every tile within STEP/2 + 1 cells of them; that covers every
+   //  sample test_arc takes in between, however it rounds
+   enum {
+      STEP = 8,
+      NEAR = STEP/2 + 1
+   };
+   const double step = STEP * G::res();
+   const int steps = ceil(l / step);
+   const double cx = x - r * sin(theta);
+   const double cy = y + r * cos(theta);
+   cell_bounds last;
+   for( int n=0; n<=steps; n++ ) {
+      double u = x + n * step * cos(theta);
+      double v = y + n * step * sin(theta);
+      if( r != 0.0 ) {
+         double phi = theta + n * step / r;
+         u = cx + r * sin(phi);
+         v = cy - r * cos(phi);
+      }
+      const int i = fixed_cell(G::fixed(u));
+      const int j = fixed_cell(G::fixed(v));
+      cell_bounds near(i - NEAR, j - NEAR, i + NEAR, j + NEAR);
+      near.clip(N);
+      if( near.empty() ) continue;
+      cell_bounds t(near.i0 >> STAMP_BITS, near.j0 >> STAMP_BITS,
+            near.i1 >> STAMP_BITS, near.j1 >> STAMP_BITS);
+      if( t.i0 == last.i0 && t.j0 == last.j0 && t.i1 == last.i1 &&
+            t.j1 == last.j1 ) {
+         continue;
+      }
+      for( int ti=t.i0; ti<=t.i1; ti++ ) {
+         for( int tj=t.j0; tj<=t.j1; tj++ ) {
+            if( tile_stamp_[ti * STAMP_TILES + tj] > since ) return true;
+         }
+      }
+      last = t;
+   }
+   return false;
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::advance_epoch() {
+   obstacles_.advance_epoch();
+}
+
+template<class G, class Layout>
+bool GridMap<G, Layout>::catch_up(int tiles) {
+   cell_bounds b = obstacles_.seen();
+   b.clip(N);
+   if( b.empty() ) return false;
+   const int ti0 = b.i0 >> STAMP_BITS;
+   const int tj0 = b.j0 >> STAMP_BITS;
+   const int width = (b.j1 >> STAMP_BITS) - tj0 + 1;
+   const int count = ((b.i1 >> STAMP_BITS) - ti0 + 1) * width;
+   // at most one lap, wrapping; only tiles with evidence to decay count
+   //  against tiles
+   bool more = false;
+   for( int k=0; k<count; k++ ) {
+      if( catch_up_ >= count ) catch_up_ = 0;
+      const int i = (ti0 + catch_up_ / width) << STAMP_BITS;
+      const int j = (tj0 + catch_up_ % width) << STAMP_BITS;
+      if( obstacles_.stale(i, j) ) {
+         if( tiles == 0 ) {
+            more = true;
+            break;
+         }
+         if( !obstacles_.tile_empty(i, j) ) --tiles;
+         obstacles_.touch(i, j);
+      }
+      ++catch_up_;
+   }
+   composite();
+   return more;
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::read_tile(int ti, int tj, map_type * out) {
+   const int i0 = ti << STAMP_BITS;
+   const int j0 = tj << STAMP_BITS;
+   // decay tiles are MAP_TILE square too; catch this one up
+   if( i0 < N && j0 < N && obstacles_.stale(i0, j0) ) {
+      obstacles_.touch(i0, j0);
+      composite();
+   }
+   for( int di=0; di<MAP_TILE; di++ ) {
+      for( int dj=0; dj<MAP_TILE; dj++ ) {
+         const int i = i0 + di;
+         const int j = j0 + dj;
+         out[di * MAP_TILE + dj] = i < N && j < N ?
+            data_[Layout::index(i, j)] : 0;
+      }
+   }
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::local_clear(double x, double y) {
+   local_i_ = fixed_cell(G::fixed(x));
+   local_j_ = fixed_cell(G::fixed(y));
+   std::fill(local_.begin(), local_.end(), 0);
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::local_center(double & x, double & y) const {
+   x = G::world(local_i_);
+   y = G::world(local_j_);
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::trace(map_type * local, const local_ray & ray,
+      cell_bounds & touched) const {
+   const int L = local_size_;
+   // fixed-point local map coordinates
+   fixed_t u = G::fixed(ray.x) - (local_i_ - L/2) * FIXED_ONE;
+   fixed_t v = G::fixed(ray.y) - (local_j_ - L/2) * FIXED_ONE;
+   fixed_t du = to_fixed(ray.c / 2.0);
+   fixed_t dv = to_fixed(ray.s / 2.0);
+   const int steps = ceil(ray.r / (G::res() / 2.0));
+   // the ray is straight, so its ends bound every cell it marks
+   int j = -1;
+   int k = -1;
+   for( int n=0; n<steps; n++, u += du, v += dv ) {
+      const int nj = fixed_cell(u);
+      const int nk = fixed_cell(v);
+      if( nj > 0 && nk > 0 && nj < L && nk < L ) {
+         if( j < 0 ) touched.include(nj, nk);
+         j = nj;
+         k = nk;
+         local[j*L + k] = -1;
+      } else {
+         break; // if we step outside the local map bounds, we're done
+      }
+   }
+   if( j >= 0 ) touched.include(j, k);
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::local_raytrace(double x, double y,
+      double c, double s, double r) {
+   local_ray ray = { x, y, c, s, r };
+   cell_bounds touched;
+   trace(&local_[0], ray, touched);
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::trace_part(const local_rays * rays,
+      int n, int k) {
+   map_type * local = k ? &thread_local_[k - 1][0] : &local_[0];
+   cell_bounds & touched = thread_touched_[k];
+   const size_t end = rays->size() * (k + 1) / n;
+   for( size_t r = rays->size() * k / n; r < end; r++ ) {
+      trace(local, (*rays)[r], touched);
+   }
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::local_raytrace(const local_rays & rays,
+      WorkerPool * pool) {
+   // below this many rays a thread costs more to wake than it saves
+   const size_t MIN_RAYS = 64;
+   int n = 1;
+   if( pool ) {
+      n = std::max(1, std::min(pool->size(), (int)(rays.size() / MIN_RAYS)));
+   }
+
+   const int L = local_size_;
+   while( (int)thread_local_.size() < n - 1 ) {
+      thread_local_.push_back(local_cells(L * L));
+   }
+   thread_touched_.assign(n, cell_bounds());
+   if( n == 1 ) {
+      trace_part(&rays, 1, 0);
+      return;
+   }
+   pool->run(n, boost::bind(&GridMap::trace_part, this, &rays, n, _1));
+
+   // free space seen by any thread is free. each thread only marked a
+   //  sector, so only its bounds are merged, and left unknown again for
+   //  next time
+   for( int t=1; t<n; t++ ) {
+      const cell_bounds & b = thread_touched_[t];
+      map_type * other = &thread_local_[t - 1][0];
+      for( int j=b.i0; j<=b.i1; j++ ) {
+         for( int k=b.j0; k<=b.j1; k++ ) {
+            local_[j*L + k] = std::min(local_[j*L + k], other[j*L + k]);
+            other[j*L + k] = 0;
+         }
+      }
+   }
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::local_mark(double x, double y) {
+   const int L = local_size_;
+   int j = fixed_cell(G::fixed(x)) - local_i_ + L/2;
+   int k = fixed_cell(G::fixed(y)) - local_j_ + L/2;
+   if( j > 0 && k > 0 && j < L && k < L ) {
+      local_[j*L + k] = 1;
+   }
+}
+
+template<class G, class Layout>
+void GridMap<G, Layout>::local_merge(double x, double y, double theta) {
+   const int L = local_size_;
+   obstacles_.merge(&local_[0], L, local_i_ - L/2, local_j_ - L/2);
+
+   // the sensors see bits of the robot; nothing under it is an obstacle
+   footprint_.set(x, y, theta);
+   obstacles_.clear(footprint_.cells());
+
+   composite();
+}
+
+#endif
@@ -0,0 +1,129 @@
+/* inflation_layer.h
+ *
+ * Costmap layer that grows obstacles by the radius of the robot, so the
+ * planner can collision-check the robot's center point alone.
+ *
+ * Every cell counts the occupied cells within the radius of it, and is
+ * inflated while its count is non-zero. Each obstacle cell that appears or
+ * disappears adds or removes one disk of counts, so the inflation is
+ * always exactly that of the current obstacles, and an update costs one
+ * disk per flipped cell however large the map or the changed region is.
+ * Only cells whose count crosses zero are recomposited.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_INFLATION_LAYER_H
+#define DAGNY_INFLATION_LAYER_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <path_planner/costmap_layer.h>
+#include <path_planner/map_alloc.h>
+#include <path_planner/obstacle_layer.h>
+
+template<class G, class Layout>
+class InflationLayer : public CostmapLayer<G, Layout> {
+   public:
+      // inflate the obstacles in obstacles by radius meters. the counts
+      //  are allocated like the other layers; see map_alloc.h
+      InflationLayer(ObstacleLayer<G, Layout> & obstacles, double radius,
+            map_pages pages, int numa_node);
+
+      virtual ~InflationLayer() {
+         map_free(alloc_);
+      }
+
+      // number of obstacle cells within the radius of each cell
+      const uint16_t * counts() const { return counts_; }
+
+      // apply the obstacles' flips, and add the cells that gained or lost
+      //  inflation
+      virtual void update_bounds(dirty_tiles<G::size> & d);
+
+      virtual void update_costs(map_type * master, const cell_bounds & b);
+
+   private:
+      enum {
+         N = G::size
+      };
+
+      // add delta to the count of every cell within the radius of (i, j)
+      void stamp(int i, int j, int delta);
+
+      ObstacleLayer<G, Layout> & obstacles_;
+      // radius, in cells
+      int r_;
+      // half-width of the disk at each row offset -r_..r_
+      std::vector<int> span_;
+
+      map_allocation alloc_;
+      uint16_t * counts_;
+
+      // scratch for the obstacles' flips
+      std::vector<cell_flip> flips_;
+      // tiles with cells that gained or lost inflation since the last
+      //  update
+      dirty_tiles<G::size> changed_;
+
+      // not copyable
+      InflationLayer(const InflationLayer &);
+      InflationLayer & operator=(const InflationLayer &);
+};
+
+template<class G, class Layout>
+InflationLayer<G, Layout>::InflationLayer(
+      ObstacleLayer<G, Layout> & obstacles, double radius,
+      map_pages pages, int numa_node) :
+   obstacles_(obstacles), r_(radius / G::res() + 1e-6),
+   span_(2*r_ + 1) {
+   for( int d = -r_; d <= r_; d++ ) {
+      span_[d + r_] = sqrt((double)(r_*r_ - d*d)) + 1e-6;
+   }
+   map_alloc(Layout::cells * sizeof(uint16_t), pages, numa_node, alloc_);
+   counts_ = (uint16_t*)alloc_.data;
+}
+
+template<class G, class Layout>
+void InflationLayer<G, Layout>::stamp(int i, int j, int delta) {
+   for( int di = std::max(-r_, -i); di <= std::min(r_, (int)N - 1 - i);
+         di++ ) {
+      const int s = span_[di + r_];
+      for( int dj = std::max(-s, -j); dj <= std::min(s, (int)N - 1 - j);
+            dj++ ) {
+         uint16_t & n = counts_[Layout::index(i + di, j + dj)];
+         const bool was = n != 0;
+         n += delta;
+         if( was != (n != 0) ) changed_.include(i + di, j + dj);
+      }
+   }
+}
+
+template<class G, class Layout>
+void InflationLayer<G, Layout>::update_bounds(dirty_tiles<G::size> & d) {
+   obstacles_.take_flips(flips_);
+   for( size_t k=0; k<flips_.size(); k++ ) {
+      stamp(flips_[k].i, flips_[k].j, flips_[k].occupied ? 1 : -1);
+   }
+   d.include(changed_);
+   changed_.clear();
+}
+
+template<class G, class Layout>
+void InflationLayer<G, Layout>::update_costs(map_type * master,
+      const cell_bounds & b) {
+   for( int i=b.i0; i<=b.i1; i++ ) {
+      for( int j=b.j0; j<=b.j1; j++ ) {
+         size_t c = Layout::index(i, j);
+         if( counts_[c] && master[c] < COST_INFLATED ) {
+            master[c] = COST_INFLATED;
+         }
+      }
+   }
+}
+
+#endif
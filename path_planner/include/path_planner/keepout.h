@@ -0,0 +1,46 @@
+/* keepout.h
+ *
+ * Keepout zones: polygons the robot must never enter, such as fountains,
+ * roads and out-of-bounds areas.
+ *
+ * Zones are given in UTM or odometry coordinates, and rasterized into the
+ * map's static layer with a scanline fill.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_KEEPOUT_H
+#define DAGNY_KEEPOUT_H
+
+#include <string>
+#include <vector>
+
+struct keepout_zone {
+   // true if the vertices are UTM easting/northing, false for odometry
+   bool utm;
+   std::vector<double> x;
+   std::vector<double> y;
+};
+
+// load zones from a text file: one polygon per line, as a frame ("utm" or
+//  "odom") followed by x y pairs. blank lines and lines starting with #
+//  are ignored. false with a message in error if the file is malformed
+bool load_keepout_file(const std::string & path,
+      std::vector<keepout_zone> & zones, std::string & error);
+
+// a run of cells (i, j0..j1)
+struct cell_span {
+   int i;
+   int j0;
+   int j1;
+};
+
+// every cell of a size x size grid whose center is inside the polygon
+//  (u, v), given in fractional cell coordinates. rows are filled by
+//  crossing the polygon edges with the row's center line, so any simple or
+//  self-intersecting polygon fills by the even-odd rule
+void scanline_fill(const std::vector<double> & u,
+      const std::vector<double> & v, int size,
+      std::vector<cell_span> & spans);
+
+#endif
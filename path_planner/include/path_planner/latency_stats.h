@@ -0,0 +1,54 @@
+/* latency_stats.h
+ *
+ * Latency histogram for a real-time thread to record into and another
+ * thread to report from.
+ *
+ * Samples go into logarithmic buckets, eight per power of two, so any
+ * percentile is known to within 12.5% whatever the range. Recording is a
+ * couple of relaxed atomic adds: no locks, no allocation, no syscalls.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_LATENCY_STATS_H
+#define DAGNY_LATENCY_STATS_H
+
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+
+// microseconds up to about 16s; longer samples count in the last bucket
+#define LATENCY_BUCKETS 184
+
+// the samples taken from a LatencyStats
+struct latency_summary {
+   uint64_t count;
+   // microseconds; the upper edge of the bucket each falls in
+   double p50;
+   double p99;
+   double p999;
+   // the longest sample, exactly
+   double max;
+};
+
+class LatencyStats {
+   public:
+      LatencyStats();
+
+      // add a sample of seconds. negative samples count as 0
+      void record(double seconds);
+
+      // summarize the samples since the last take, and start over.
+      //  samples recorded meanwhile land on one side or the other
+      latency_summary take();
+
+   private:
+      boost::atomic<uint32_t> buckets_[LATENCY_BUCKETS];
+      boost::atomic<uint64_t> max_us_;
+
+      // not copyable
+      LatencyStats(const LatencyStats &);
+      LatencyStats & operator=(const LatencyStats &);
+};
+
+#endif
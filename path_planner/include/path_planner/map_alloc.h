@@ -0,0 +1,47 @@
+/* map_alloc.h
+ *
+ * Page-aware allocation for the obstacle map.
+ *
+ * The map is tens of megabytes and accessed all over; with 4k pages the
+ * planner spends a good part of its time in TLB misses. These allocate
+ * the map on 2MB pages when the system allows it, optionally on a
+ * preferred NUMA node, and fall back to ordinary pages when it doesn't.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_MAP_ALLOC_H
+#define DAGNY_MAP_ALLOC_H
+
+#include <stddef.h>
+
+enum map_pages {
+   PAGES_DEFAULT = 0,     // ordinary pages
+   PAGES_TRANSPARENT = 1, // 2MB aligned, madvise(MADV_HUGEPAGE)
+   PAGES_HUGE = 2         // explicit hugetlbfs pages, MAP_HUGETLB
+};
+
+// a block of zeroed memory from map_alloc
+struct map_allocation {
+   void * data;
+   size_t bytes;  // mapped length; at least what was asked for
+   map_pages pages; // what we actually got
+};
+
+// allocate bytes of zeroed memory, backed by the requested kind of pages
+//  if possible and the next smaller kind if not. if numa_node >= 0, prefer
+//  placing the pages on that node. false if even ordinary pages failed
+bool map_alloc(size_t bytes, map_pages pages, int numa_node,
+      map_allocation & out);
+
+void map_free(map_allocation & a);
+
+// fault in [p, p + bytes) ahead of use, without changing its contents.
+//  safe to call while other threads read and write the memory
+void map_prefault(const void * p, size_t bytes);
+
+// parse "default", "transparent" or "huge"; PAGES_DEFAULT otherwise
+map_pages map_pages_from_string(const char * s);
+const char * map_pages_name(map_pages pages);
+
+#endif
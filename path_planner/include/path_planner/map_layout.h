@@ -0,0 +1,88 @@
+/* map_layout.h
+ *
+ * Memory layouts for the obstacle map.
+ *
+ * A layout maps cell (i, j) of a SIZE x SIZE map to an offset in the cell
+ * buffer. Row-major puts vertical neighbours SIZE bytes apart, so an arc
+ * walking along i touches a new cache line (and soon a new page) on every
+ * step. The blocked layout stores the map as square 2^BITS x 2^BITS
+ * blocks, each contiguous, so nearby cells share lines and pages no matter
+ * which way the robot is heading. With ZORDER the cells inside a block are
+ * in Morton order, which also makes every aligned 8x8 sub-block a single
+ * 64-byte cache line.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_MAP_LAYOUT_H
+#define DAGNY_MAP_LAYOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+template<int SIZE>
+struct row_major_layout {
+   enum {
+      cells = SIZE * SIZE
+   };
+
+   static size_t index(int i, int j) {
+      return (size_t)i * SIZE + j;
+   }
+
+   // the range of offsets holding row i and whatever shares its storage
+   static size_t row_begin(int i) {
+      return (size_t)i * SIZE;
+   }
+   static size_t row_end(int i) {
+      return (size_t)(i + 1) * SIZE;
+   }
+};
+
+// spread the low 8 bits of x out to the even bits
+inline uint32_t morton_spread(uint32_t x) {
+   x = (x | (x << 4)) & 0x0F0F;
+   x = (x | (x << 2)) & 0x3333;
+   x = (x | (x << 1)) & 0x5555;
+   return x;
+}
+
+template<int SIZE, int BITS, bool ZORDER>
+struct blocked_layout {
+   enum {
+      block = 1 << BITS,
+      mask = (1 << BITS) - 1,
+      // blocks per side; the last row and column of blocks are padded
+      blocks = (SIZE + (1 << BITS) - 1) >> BITS,
+      cells = blocks * blocks << (2 * BITS)
+   };
+
+   static size_t index(int i, int j) {
+      size_t b = (size_t)(i >> BITS) * blocks + (j >> BITS);
+      uint32_t in;
+      if( ZORDER ) {
+         in = (morton_spread(i & mask) << 1) | morton_spread(j & mask);
+      } else {
+         in = ((i & mask) << BITS) | (j & mask);
+      }
+      return (b << (2 * BITS)) | in;
+   }
+
+   // the range of offsets holding row i and whatever shares its storage:
+   //  its whole row of blocks
+   static size_t row_begin(int i) {
+      return (size_t)(i >> BITS) * blocks << (2 * BITS);
+   }
+   static size_t row_end(int i) {
+      return (size_t)((i >> BITS) + 1) * blocks << (2 * BITS);
+   }
+};
+
+// page-sized blocks, Morton order inside. 64x64 blocks also line up with
+//  the decay tiles, so decaying a tile is one contiguous 4k sweep
+template<int SIZE>
+struct default_layout {
+   typedef blocked_layout<SIZE, 6, true> type;
+};
+
+#endif
@@ -0,0 +1,90 @@
+/* map_pyramid.h
+ *
+ * Multi-resolution "any occupied" pyramid over the obstacle map.
+ *
+ * Level L holds one byte per 2^L x 2^L block of map cells, set if any cell
+ * in that block is non-zero (max pooling). Collision queries use it to skip
+ * through empty blocks in one step instead of walking every cell.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_MAP_PYRAMID_H
+#define DAGNY_MAP_PYRAMID_H
+
+#include <stdint.h>
+
+#include <path_planner/grid.h>
+
+class MapPyramid {
+   public:
+      // pyramid over a size x size map, with block sizes 2, 4, ... 2^levels
+      MapPyramid(int size, int levels = 6);
+      ~MapPyramid();
+
+      // recompute every block covering map cells (i0..i1, j0..j1), inclusive
+      //  base is the map, stored in Layout order (see map_layout.h)
+      template<class Layout>
+      void update(const int8_t * base, int i0, int j0, int i1, int j1);
+
+      // rebuild the entire pyramid from the map
+      template<class Layout>
+      void rebuild(const int8_t * base) {
+         update<Layout>(base, 0, 0, size_ - 1, size_ - 1);
+      }
+
+      // distance from the point (u, v) to the edge of the largest empty
+      //  block that contains it. (u, v) and the result are fixed-point cell
+      //  coordinates; cell (i, j) spans [i-0.5, i+0.5) x [j-0.5, j+0.5)
+      //  returns 0 if no block at level 1 or above is empty
+      fixed_t free_margin(fixed_t u, fixed_t v) const;
+
+      int levels() const { return levels_; }
+
+   private:
+      // side length of level l, in blocks
+      int level_size(int l) const { return (size_ + (1 << l) - 1) >> l; }
+
+      // clip (i0..i1, j0..j1) to the map. false if nothing is left
+      bool clip(int & i0, int & j0, int & i1, int & j1) const;
+
+      // recompute levels 2 and up over map cells (i0..i1, j0..j1)
+      void pool(int i0, int j0, int i1, int j1);
+
+      int size_;
+      int levels_;
+      // level_[0] is unused; level_[l] holds level_size(l)^2 blocks
+      uint8_t ** level_;
+
+      // not copyable
+      MapPyramid(const MapPyramid &);
+      MapPyramid & operator=(const MapPyramid &);
+};
+
+template<class Layout>
+void MapPyramid::update(const int8_t * base, int i0, int j0, int i1, int j1) {
+   if( !clip(i0, j0, i1, j1) ) return;
+
+   // level 1 pools directly from the map; cells past the edge are empty
+   int n = level_size(1);
+   uint8_t * dst = level_[1];
+   for( int bi = i0 >> 1; bi <= i1 >> 1; bi++ ) {
+      int ci = bi << 1;
+      for( int bj = j0 >> 1; bj <= j1 >> 1; bj++ ) {
+         int cj = bj << 1;
+         bool any = base[Layout::index(ci, cj)] != 0;
+         if( cj + 1 < size_ ) any = any || base[Layout::index(ci, cj+1)] != 0;
+         if( ci + 1 < size_ ) {
+            any = any || base[Layout::index(ci+1, cj)] != 0;
+            if( cj + 1 < size_ ) {
+               any = any || base[Layout::index(ci+1, cj+1)] != 0;
+            }
+         }
+         dst[bi*n + bj] = any;
+      }
+   }
+
+   pool(i0, j0, i1, j1);
+}
+
+#endif
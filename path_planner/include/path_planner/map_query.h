@@ -0,0 +1,48 @@
+/* map_query.h
+ *
+ * Batched point, ray and arc queries against the obstacle map, for
+ * anything that wants to know what the planner's map says without keeping
+ * a copy of it.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_MAP_QUERY_H
+#define DAGNY_MAP_QUERY_H
+
+#include <vector>
+
+#include <path_planner/obstacle_map.h>
+
+struct map_query {
+   enum query_type {
+      POINT, // is the cell at (x, y) free?
+      RAY,   // how far from (x, y) along theta to the first blocked cell?
+      ARC    // is the arc from (x, y, theta), radius r, length l clear?
+   };
+   query_type type;
+   double x;
+   double y;
+   double theta;
+   double r;
+   // length of an arc, or the longest range a ray is traced for
+   double l;
+};
+
+struct map_answer {
+   // the point is free, the ray reached l, or the arc is clear
+   bool clear;
+   // points: the cell's cost. see costmap_layer.h
+   map_type cost;
+   // rays: distance to the first blocked cell, or l
+   double range;
+};
+
+// answer every query in q against map, into a (in the same order as q).
+//  queries are evaluated grouped by the map tile they start in, so ones
+//  near each other share cache lines, pages and lazy decay instead of
+//  fetching them once per query
+void answer_queries(ObstacleMap & map, const std::vector<map_query> & q,
+      std::vector<map_answer> & a);
+
+#endif
@@ -0,0 +1,173 @@
+/* map_share.h
+ *
+ * Obstacle evidence shared between robots on the same course, so each
+ * doesn't have to discover every obstacle for itself.
+ *
+ * Robots exchange tile deltas in a shared frame (UTM, less a common
+ * origin), on a grid of the maps' resolution whose cells are centered on
+ * multiples of it. A robot's map tiles that changed are sampled onto the
+ * shared grid and compared with a shadow of what was last sent from each
+ * shared tile; a cell is sent when its evidence rises, or falls to
+ * nothing. Decay, which every robot applies to its own map, isn't sent.
+ *
+ * Each delta carries its sender's version of the tile, and a delta no
+ * newer than the last one applied from that sender and tile is dropped,
+ * so late and duplicated deltas do no harm. Versions start again at 1
+ * when a robot restarts, so every batch also carries a session id picked
+ * at random each time a robot starts sharing; a new session from a
+ * robot forgets the versions applied from its last one. Deltas are applied as they
+ * arrive and the robot's own scans overwrite them in turn: the last
+ * writer of a cell wins. Cells written by others are noted in the shadow,
+ * so they aren't sent back.
+ *
+ * A batch of deltas is, little-endian:
+ *
+ *    u32 robot         the sender's id
+ *    u32 session       the sender's session
+ *    f32 resolution    meters per cell; batches at any other are dropped
+ *    u16 deltas        number of deltas that follow, each:
+ *       i32 ti, tj     shared tile, MAP_TILE cells per side
+ *       u32 version    the sender's version of the tile
+ *       u16 cells      number of cells that follow, each:
+ *          u16 index   row-major, within the tile
+ *          u8  value   evidence
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_MAP_SHARE_H
+#define DAGNY_MAP_SHARE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <path_planner/mem_account.h>
+#include <path_planner/obstacle_map.h>
+
+// carries batches between robots
+class MapShareTransport {
+   public:
+      virtual ~MapShareTransport() {}
+
+      virtual void send(const std::vector<uint8_t> & batch) = 0;
+      // the next batch received, if there is one
+      virtual bool receive(std::vector<uint8_t> & batch) = 0;
+};
+
+// connects robots in the same process: every batch sent is received by
+//  every transport connected to the sender
+class LoopbackTransport : public MapShareTransport {
+   public:
+      LoopbackTransport() {}
+
+      void connect(LoopbackTransport & other) {
+         peers_.push_back(&other);
+         other.peers_.push_back(this);
+      }
+
+      virtual void send(const std::vector<uint8_t> & batch) {
+         for( size_t k=0; k<peers_.size(); k++ ) {
+            peers_[k]->inbox_.push_back(batch);
+         }
+      }
+
+      virtual bool receive(std::vector<uint8_t> & batch) {
+         if( inbox_.empty() ) return false;
+         batch.swap(inbox_.front());
+         inbox_.pop_front();
+         return true;
+      }
+
+   private:
+      std::vector<LoopbackTransport*> peers_;
+      std::deque<std::vector<uint8_t> > inbox_;
+
+      // not copyable
+      LoopbackTransport(const LoopbackTransport &);
+      LoopbackTransport & operator=(const LoopbackTransport &);
+};
+
+// where the shared frame is: the pose of its origin in the map frame
+struct share_frame {
+   double x;
+   double y;
+   double theta;
+
+   share_frame() : x(0.0), y(0.0), theta(0.0) {}
+};
+
+class MapShare {
+   public:
+      // share as robot id, which must be unique among the robots sharing,
+      //  in a new session
+      MapShare(uint32_t robot, MapShareTransport & transport);
+
+      // send one batch of at most max_bytes of the changes to map. changes
+      //  that don't fit wait for the next batch, oldest first. returns the
+      //  bytes sent
+      size_t send(ObstacleMap & map, const share_frame & frame,
+            size_t max_bytes);
+
+      // apply every batch received from the other robots to map. returns
+      //  the number of deltas applied
+      int receive(ObstacleMap & map, const share_frame & frame);
+
+      // deltas dropped as out of date, and batches dropped as malformed or
+      //  at the wrong resolution
+      uint64_t stale() const { return stale_; }
+      uint64_t rejected() const { return rejected_; }
+
+   private:
+      typedef std::pair<int32_t, int32_t> tile_key;
+
+      struct shadow {
+         uint32_t version;
+         std::vector<map_type, tagged_allocator<map_type, MEM_SHARE> > cells;
+
+         shadow() : version(0), cells(MAP_TILE * MAP_TILE) {}
+      };
+
+      // queue the shared tiles under map tiles that changed since the last
+      //  send
+      void find_changes(ObstacleMap & map, const share_frame & frame);
+
+      uint32_t robot_;
+      uint32_t session_;
+      MapShareTransport & transport_;
+
+      // the map, and its stamp(), as of the last send
+      const ObstacleMap * map_;
+      uint32_t stamp_;
+
+      std::map<tile_key, shadow> shadows_;
+      // shared tiles waiting to be sent, oldest first
+      std::deque<tile_key> queue_;
+      std::set<tile_key> queued_;
+
+      // the newest version applied from each robot's tiles, in each
+      //  robot's current session
+      std::map<std::pair<uint32_t, tile_key>, uint32_t> applied_;
+      std::map<uint32_t, uint32_t> sessions_;
+
+      uint64_t stale_;
+      uint64_t rejected_;
+
+      // scratch
+      std::vector<uint8_t> batch_;
+      std::vector<std::pair<uint16_t, map_type> > changes_;
+      std::vector<double> x_;
+      std::vector<double> y_;
+      std::vector<map_type> v_;
+
+      // not copyable
+      MapShare(const MapShare &);
+      MapShare & operator=(const MapShare &);
+};
+
+#endif
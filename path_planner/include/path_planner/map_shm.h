@@ -0,0 +1,168 @@
+/* map_shm.h
+ *
+ * The obstacle map, published in a POSIX shared-memory segment so other
+ * processes on the robot can read it in place: no copies, no
+ * serialization, and no ROS connection.
+ *
+ * The segment is a map_shm_header, a table of one map_shm_tile per map
+ * tile, then the costs, tile by tile: tile (ti, tj) is MAP_TILE x MAP_TILE
+ * row-major cells starting at cell (ti * MAP_TILE, tj * MAP_TILE). The
+ * writer copies only the tiles that changed since its last pass over them.
+ *
+ * Consistency is by seqlock: the writer makes a sequence number odd
+ * before it writes and even again after, and a reader that sees the same
+ * even number before and after its read knows nothing moved underneath
+ * it. The header's sequence number covers a whole publish, each tile's
+ * covers that tile. Readers never write to the segment, so any number of
+ * them can map it read-only.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_MAP_SHM_H
+#define DAGNY_MAP_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include <path_planner/obstacle_map.h>
+
+#define MAP_SHM_MAGIC 0x4d415053 // "MAPS"
+#define MAP_SHM_VERSION 1
+
+struct map_shm_header {
+   uint32_t magic;
+   uint32_t version;
+   // set when the writer has replaced or removed the segment; reopen it
+   uint32_t stale;
+   // seqlock over a whole publish; odd while one is being written
+   uint32_t seq;
+   // number of publishes so far
+   uint32_t epoch;
+   // cells per side of the map, and of a tile; tiles per side of the map
+   int32_t size;
+   int32_t tile;
+   int32_t tiles;
+   // meters per cell. the center of cell (i, j) is at
+   //  ((i - size/2) * resolution, (j - size/2) * resolution) in frame
+   double resolution;
+   char frame[64];
+   // the robot's pose in frame, and its time
+   double stamp;
+   double robot_x;
+   double robot_y;
+   double robot_theta;
+};
+
+struct map_shm_tile {
+   // seqlock over this tile's cells; odd while they're being written
+   uint32_t seq;
+   // epoch of the publish that last changed this tile
+   uint32_t epoch;
+};
+
+// total size of the segment for a map of size cells per side
+size_t map_shm_bytes(int size);
+
+class MapShmWriter {
+   public:
+      // publish into the segment called name; see shm_open(3)
+      explicit MapShmWriter(const std::string & name);
+      // marks the segment stale and removes it
+      ~MapShmWriter();
+
+      // copy up to max_tiles of the tiles of map that changed since the
+      //  last full pass into the segment, carrying on from where the last
+      //  call stopped, and the pose of the robot in it. each call is a
+      //  whole publish as readers see it, so a pass can be split across
+      //  calls without holding the map the whole time. the segment is
+      //  laid out again, and readers told to reopen it, when the map's
+      //  geometry changes; the first pass, and the first after the map
+      //  object changes, copy every tile. false if the segment can't be
+      //  created
+      bool publish(ObstacleMap & map, const std::string & frame,
+            double stamp, double x, double y, double theta, int max_tiles);
+
+      // the last publish stopped at max_tiles, part way through a pass
+      bool partway() const { return next_ != 0; }
+
+   private:
+      bool create(int size, double resolution);
+      void destroy();
+
+      std::string name_;
+      void * base_;
+      size_t bytes_;
+      map_shm_header * header_;
+      map_shm_tile * tiles_;
+      map_type * cells_;
+
+      // the map last published, and its stamp() as the last full pass
+      //  began
+      const ObstacleMap * map_;
+      uint32_t published_;
+      // the pass in progress: the next tile it looks at, row-major, map's
+      //  stamp() as it began, and whether it copies every tile
+      int next_;
+      uint32_t pass_;
+      bool full_;
+
+      // not copyable
+      MapShmWriter(const MapShmWriter &);
+      MapShmWriter & operator=(const MapShmWriter &);
+};
+
+class MapShmReader {
+   public:
+      MapShmReader();
+      ~MapShmReader();
+
+      // map the segment called name read-only. false if there isn't one,
+      //  or it isn't a map
+      bool open(const std::string & name);
+      void close();
+      bool is_open() const { return base_ != 0; }
+
+      // the writer has replaced the segment since it was opened
+      bool stale() const;
+
+      // header fields, valid while open. the robot pose and stamp may
+      //  change during a publish; read them inside begin()/end()
+      const map_shm_header & header() const { return *header_; }
+
+      // zero-copy reads: note begin(), read the header or cells in place,
+      //  then the reads are consistent if end() is true for what begin()
+      //  returned; otherwise try again. end() is never true if a publish
+      //  was in progress at begin(), and neither ever blocks, so a writer
+      //  that dies mid-publish can't hang its readers
+      uint32_t begin() const;
+      bool end(uint32_t seq) const;
+
+      // the cells of tile (ti, tj), MAP_TILE x MAP_TILE row-major. only
+      //  consistent between begin() and a true end(), or between
+      //  tile_begin() and a true tile_end()
+      const map_type * tile(int ti, int tj) const;
+      uint32_t tile_begin(int ti, int tj) const;
+      bool tile_end(int ti, int tj, uint32_t seq) const;
+      // epoch of the publish that last changed tile (ti, tj)
+      uint32_t tile_epoch(int ti, int tj) const;
+
+      // copy tile (ti, tj) into out, consistently. false if the writer
+      //  kept changing it for tries attempts
+      bool read_tile(int ti, int tj, map_type * out, int tries = 8) const;
+
+   private:
+      void * base_;
+      size_t bytes_;
+      const map_shm_header * header_;
+      const map_shm_tile * tiles_;
+      const map_type * cells_;
+
+      // not copyable
+      MapShmReader(const MapShmReader &);
+      MapShmReader & operator=(const MapShmReader &);
+};
+
+#endif
@@ -0,0 +1,142 @@
+/* map_stream.h
+ *
+ * A compressed stream of map tiles, for watching the map over a link too
+ * slow for raw grids.
+ *
+ * The encoder reads the shared-memory map (see map_shm.h) and sends the
+ * tiles that changed since it last sent them, nearest the robot and
+ * longest waiting first, within a byte budget per frame. Every so often
+ * it starts a keyframe, which sends every tile again, so a decoder that
+ * joins late or loses frames converges on the map. The decoder rebuilds
+ * the map from the frames, and counts the frames lost along the way.
+ *
+ * A frame is, little-endian:
+ *
+ *    u32 seq           one more than the last frame's
+ *    u8  flags         MAP_STREAM_KEYFRAME_BEGIN | MAP_STREAM_KEYFRAME_END
+ *    u32 size          cells per side of the map
+ *    f32 resolution    meters per cell
+ *    f64 stamp         time, and robot pose in the map frame
+ *    f32 robot x, y, theta
+ *    u16 tiles         number of tiles that follow, each:
+ *       u16 ti, tj     tile coordinates, MAP_TILE cells per side
+ *       u16 bytes      length of the runs that follow
+ *       runs           the tile's cells, row-major, as runs of one cost.
+ *                      each run is a byte (length - 1) << 2 | cost, for
+ *                      runs of 1 to 63 cells; a length field of 63 is
+ *                      followed by a varint of the run's length - 64.
+ *
+ * Almost every cell of a map is free, so an empty tile is 3 bytes of runs
+ * and an ordinary one a few dozen.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_MAP_STREAM_H
+#define DAGNY_MAP_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+#include <path_planner/map_shm.h>
+#include <path_planner/obstacle_map.h>
+
+#define MAP_STREAM_KEYFRAME_BEGIN 1
+#define MAP_STREAM_KEYFRAME_END 2
+
+// append the runs of n cells to out. costs must fit in two bits
+void map_stream_encode_runs(const map_type * cells, size_t n,
+      std::vector<uint8_t> & out);
+// decode runs into exactly n cells. false if they're malformed
+bool map_stream_decode_runs(const uint8_t * data, size_t bytes,
+      map_type * cells, size_t n);
+
+class MapStreamEncoder {
+   public:
+      // start a keyframe every keyframe_interval seconds
+      explicit MapStreamEncoder(double keyframe_interval);
+
+      // start a keyframe with the next frame
+      void keyframe() { keyframe_due_ = true; }
+
+      // encode a frame of at most max_bytes of the tiles in map that
+      //  haven't been sent since they changed, at time now. false, and no
+      //  frame, if there is nothing to send or not even one tile fits
+      bool encode(const MapShmReader & map, double now, size_t max_bytes,
+            std::vector<uint8_t> & frame);
+
+   private:
+      double keyframe_interval_;
+      double last_keyframe_;
+      bool keyframe_due_;
+      // a keyframe is in progress, and its first frame has been sent
+      bool keyframe_;
+      bool begun_;
+      // tiles the keyframe still has to send
+      int todo_count_;
+
+      uint32_t seq_;
+      // geometry of the map the tile state is for
+      int size_;
+      double resolution_;
+      // per tile: the epoch it was last sent at, the frame it was sent in,
+      //  and whether the keyframe still has to send it
+      std::vector<uint32_t> sent_;
+      std::vector<uint32_t> sent_seq_;
+      std::vector<bool> todo_;
+
+      // scratch
+      std::vector<map_type> cells_;
+      std::vector<uint8_t> runs_;
+      std::vector<std::pair<int64_t, int> > order_;
+};
+
+class MapStreamDecoder {
+   public:
+      MapStreamDecoder();
+
+      // apply a frame. false, and no change, if it's malformed
+      bool decode(const uint8_t * frame, size_t bytes);
+
+      // the map: size x size cells, cell (i, j) at cells()[i * size + j],
+      //  centered on the origin like the planner's
+      int size() const { return size_; }
+      double resolution() const { return resolution_; }
+      const std::vector<map_type> & cells() const { return cells_; }
+      map_type get(int i, int j) const { return cells_[i * size_ + j]; }
+
+      double stamp() const { return stamp_; }
+      double robot_x() const { return robot_x_; }
+      double robot_y() const { return robot_y_; }
+      double robot_theta() const { return robot_theta_; }
+
+      // frames missed, going by the sequence numbers
+      uint64_t lost() const { return lost_; }
+      // a whole keyframe has arrived since the last frame was lost, so the
+      //  map is as good as the stream can make it
+      bool synced() const { return synced_; }
+
+   private:
+      int size_;
+      double resolution_;
+      std::vector<map_type> cells_;
+
+      double stamp_;
+      double robot_x_;
+      double robot_y_;
+      double robot_theta_;
+
+      bool started_;
+      uint32_t seq_;
+      uint64_t lost_;
+      // every frame since the current keyframe began has arrived
+      bool keyframe_intact_;
+      bool synced_;
+
+      std::vector<map_type> tile_;
+};
+
+#endif
@@ -0,0 +1,30 @@
+/* mem_account.h
+ *
+ * The path planner's memory accounting tags; the counters themselves are
+ * in the mem_account package.
+ *
+ * Each subsystem's own allocations are counted against its tag: the map's
+ * page allocations through map_alloc, its containers through
+ * tagged_allocator. The counters are atomics, so any thread may allocate,
+ * and cheap enough to leave on; a steady climb in a tag's allocation count
+ * is an allocation made per message or per cycle that ought to be reused.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_MEM_ACCOUNT_H
+#define DAGNY_MEM_ACCOUNT_H
+
+#include <mem_account/mem_account.h>
+
+enum mem_tag {
+   MEM_MAP = 0,  // map cells, costmap layers and tile stamps
+   MEM_PYRAMID,  // the map's any-occupied pyramid
+   MEM_LOCAL,    // local maps that sensor data is integrated through
+   MEM_SENSORS,  // scans and rays waiting to be integrated
+   MEM_MATCHER,  // scan matcher windows
+   MEM_SHARE,    // shared memory, streaming and sharing with other robots
+   MEM_TAGS
+};
+
+#endif
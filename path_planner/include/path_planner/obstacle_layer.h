@@ -0,0 +1,221 @@
+/* obstacle_layer.h
+ *
+ * Costmap layer holding raw obstacle evidence from the sensors.
+ *
+ * Each cell counts evidence from 0 to 4: an obstacle hit adds 2, a ray
+ * passing through takes away 1. Evidence decays lazily: the map is split
+ * into square tiles, each stamped with the decay epoch it was last brought
+ * up to date at, and a stale tile loses one count per elapsed epoch the
+ * next time it's touched, so tiles nobody looks at cost nothing.
+ *
+ * Only whether a cell holds any evidence shows up in the master grid, so
+ * the layer reports just the cells that flipped between empty and
+ * occupied, both as bounds and as a list later layers can consume.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_OBSTACLE_LAYER_H
+#define DAGNY_OBSTACLE_LAYER_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <path_planner/costmap_layer.h>
+#include <path_planner/map_alloc.h>
+
+template<class G, class Layout>
+class ObstacleLayer : public CostmapLayer<G, Layout> {
+   public:
+      ObstacleLayer(map_pages pages, int numa_node);
+      virtual ~ObstacleLayer();
+
+      map_type value(int i, int j) const {
+         return data_[Layout::index(i, j)];
+      }
+
+      // value with pending decay applied, without applying it
+      map_type peek(int i, int j) const {
+         map_type v = data_[Layout::index(i, j)];
+         int pending = std::min(epoch_ -
+               tile_epoch_[(i >> TILE_BITS) * TILES + (j >> TILE_BITS)], 4u);
+         return v > pending ? v - pending : 0;
+      }
+
+      // every cell that has ever held evidence is within seen()
+      const cell_bounds & seen() const { return seen_; }
+
+      void set(int i, int j, map_type v) {
+         touch(i, j);
+         assign(i, j, data_[Layout::index(i, j)], v);
+      }
+
+      const map_type * data() const { return data_; }
+
+      void advance_epoch() { ++epoch_; }
+
+      // true if the tile containing cell (i, j) has decay pending
+      bool stale(int i, int j) const {
+         return tile_epoch_[(i >> TILE_BITS) * TILES + (j >> TILE_BITS)] !=
+            epoch_;
+      }
+
+      // true if the tile containing cell (i, j) holds no evidence; such a
+      //  tile catches up on decay for free
+      bool tile_empty(int i, int j) const {
+         return !tile_count_[(i >> TILE_BITS) * TILES + (j >> TILE_BITS)];
+      }
+
+      // bring the tile containing cell (i, j) up to the current epoch
+      void touch(int i, int j) {
+         if( stale(i, j) ) {
+            decay(i >> TILE_BITS, j >> TILE_BITS);
+         }
+      }
+
+      // merge a size x size local map, whose cell (0, 0) is map cell
+      //  (i0, j0). -1 is free space, 1 is an obstacle, 0 is unknown
+      void merge(const map_type * local, int size, int i0, int j0);
+
+      // forget any evidence in the given cells
+      void clear(const std::vector<std::pair<int, int> > & cells);
+
+      // swap out the cells that became occupied or empty since the last
+      //  call, in the order they flipped. out is cleared first
+      void take_flips(std::vector<cell_flip> & out) {
+         out.clear();
+         out.swap(flips_);
+      }
+
+      virtual void update_bounds(dirty_tiles<G::size> & d) {
+         d.include(changed_);
+         changed_.clear();
+      }
+
+      virtual void update_costs(map_type * master, const cell_bounds & b);
+
+   private:
+      enum {
+         N = G::size,
+         TILE_BITS = MAP_TILE_BITS,
+         TILES = (G::size + (1 << TILE_BITS) - 1) >> TILE_BITS
+      };
+
+      void decay(int ti, int tj);
+
+      // set cell (i, j), whose evidence is m, to v, noting any flip
+      void assign(int i, int j, map_type & m, map_type v) {
+         if( (m > 0) != (v > 0) ) {
+            cell_flip f = { i, j, v > 0 };
+            flips_.push_back(f);
+            changed_.include(i, j);
+            uint16_t & n =
+               tile_count_[(i >> TILE_BITS) * TILES + (j >> TILE_BITS)];
+            if( v > 0 ) {
+               ++n;
+               seen_.include(i, j);
+            } else {
+               --n;
+            }
+         }
+         m = v;
+      }
+
+      map_allocation alloc_;
+      map_type * data_;
+
+      uint32_t epoch_;
+      std::vector<uint32_t, tagged_allocator<uint32_t, MEM_MAP> > tile_epoch_;
+      // cells in each tile holding evidence
+      std::vector<uint16_t, tagged_allocator<uint16_t, MEM_MAP> > tile_count_;
+
+      // tiles with cells flipped since the last update
+      dirty_tiles<G::size> changed_;
+      std::vector<cell_flip> flips_;
+      cell_bounds seen_;
+
+      // not copyable
+      ObstacleLayer(const ObstacleLayer &);
+      ObstacleLayer & operator=(const ObstacleLayer &);
+};
+
+template<class G, class Layout>
+ObstacleLayer<G, Layout>::ObstacleLayer(map_pages pages, int numa_node) :
+   epoch_(0), tile_epoch_(TILES * TILES), tile_count_(TILES * TILES) {
+   map_alloc(Layout::cells * sizeof(map_type), pages, numa_node, alloc_);
+   data_ = (map_type*)alloc_.data;
+}
+
+template<class G, class Layout>
+ObstacleLayer<G, Layout>::~ObstacleLayer() {
+   map_free(alloc_);
+}
+
+template<class G, class Layout>
+void ObstacleLayer<G, Layout>::decay(int ti, int tj) {
+   int t = ti * TILES + tj;
+   map_type elapsed = std::min(epoch_ - tile_epoch_[t], 4u);
+   tile_epoch_[t] = epoch_;
+   if( !tile_count_[t] ) return;
+
+   int i0 = ti << TILE_BITS;
+   int j0 = tj << TILE_BITS;
+   int i1 = std::min(i0 + (1 << TILE_BITS), (int)N);
+   int j1 = std::min(j0 + (1 << TILE_BITS), (int)N);
+   for( int i=i0; i<i1; i++ ) {
+      for( int j=j0; j<j1; j++ ) {
+         map_type & v = data_[Layout::index(i, j)];
+         if( v > 0 ) {
+            assign(i, j, v, v > elapsed ? v - elapsed : 0);
+         }
+      }
+   }
+}
+
+template<class G, class Layout>
+void ObstacleLayer<G, Layout>::merge(const map_type * local, int size,
+      int i0, int j0) {
+   for( int i=std::max(0, -i0); i<std::min(size, N - i0); i++ ) {
+      for( int j=std::max(0, -j0); j<std::min(size, N - j0); j++ ) {
+         touch(i0 + i, j0 + j);
+         map_type & m = data_[Layout::index(i0 + i, j0 + j)];
+         int tmp = local[i*size + j];
+         if( tmp > 0 ) tmp = 2;
+         tmp += m;
+         if( tmp > 4 ) tmp = 4;
+         if( tmp < 0 ) tmp = 0;
+         assign(i0 + i, j0 + j, m, tmp);
+      }
+   }
+}
+
+template<class G, class Layout>
+void ObstacleLayer<G, Layout>::clear(
+      const std::vector<std::pair<int, int> > & cells) {
+   for( size_t k=0; k<cells.size(); k++ ) {
+      int i = cells[k].first;
+      int j = cells[k].second;
+      if( i >= 0 && i < N && j >= 0 && j < N ) {
+         assign(i, j, data_[Layout::index(i, j)], 0);
+      }
+   }
+}
+
+template<class G, class Layout>
+void ObstacleLayer<G, Layout>::update_costs(map_type * master,
+      const cell_bounds & b) {
+   for( int i=b.i0; i<=b.i1; i++ ) {
+      for( int j=b.j0; j<=b.j1; j++ ) {
+         size_t c = Layout::index(i, j);
+         if( data_[c] > 0 && master[c] < COST_OBSTACLE ) {
+            master[c] = COST_OBSTACLE;
+         }
+      }
+   }
+}
+
+#endif
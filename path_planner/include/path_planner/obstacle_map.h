@@ -0,0 +1,165 @@
+/* obstacle_map.h
+ *
+ * The planner's obstacle map: a fixed-size grid centered on the odometry
+ * origin, plus the scratch local map that sensor data is integrated into
+ * before it's merged.
+ *
+ * All coordinates here are world coordinates in meters; the
+ * implementations convert to fixed-point cells once per call and run their
+ * inner loops on integers. The grid geometry is a template parameter of the
+ * implementation, and create() picks an instantiation at runtime.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_OBSTACLE_MAP_H
+#define DAGNY_OBSTACLE_MAP_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <path_planner/map_alloc.h>
+#include <path_planner/mem_account.h>
+
+// default local map size, in cells
+#define LOCAL_MAP_SIZE 150
+
+// the map tracks changes in square tiles of 2^MAP_TILE_BITS cells
+#define MAP_TILE_BITS 6
+#define MAP_TILE (1 << MAP_TILE_BITS)
+
+typedef int8_t map_type;
+
+// a ray for the local map: from (x, y) in direction (c, s) for r meters
+struct local_ray {
+   double x;
+   double y;
+   double c;
+   double s;
+   double r;
+};
+
+// a batch of rays, counted as sensor memory
+typedef std::vector<local_ray, tagged_allocator<local_ray, MEM_SENSORS> >
+   local_rays;
+
+class WorkerPool;
+
+class ObstacleMap {
+   public:
+      virtual ~ObstacleMap() {}
+
+      // a size x size map with res meters per cell, or NULL if there's no
+      //  instantiation for that geometry. the cells are allocated on the
+      //  given kind of pages if possible; see map_alloc.h. sensor data is
+      //  integrated through a local_size x local_size local map
+      static ObstacleMap * create(int size, double res,
+            map_pages pages = PAGES_TRANSPARENT, int numa_node = -1,
+            int local_size = LOCAL_MAP_SIZE);
+      // the k-th geometry create() can build; false if there's no k-th
+      static bool geometry(int k, int & size, double & res);
+
+      virtual int size() const = 0;
+      virtual double resolution() const = 0;
+      virtual int local_size() const = 0;
+      // the kind of pages the cells actually ended up on
+      virtual map_pages pages() const = 0;
+
+      // cost at (x, y); 0 for any point not within the map. non-zero is
+      //  an obstacle. see costmap_layer.h for the values
+      virtual map_type get(double x, double y) = 0;
+      // set the raw obstacle evidence (0..4) at (x, y)
+      virtual void set(double x, double y, map_type v) = 0;
+      // set the evidence at each (x[k], y[k]) to v[k], and recomposite once
+      virtual void set(const std::vector<double> & x,
+            const std::vector<double> & y,
+            const std::vector<map_type> & v) = 0;
+
+      // test an arc from (x, y) with heading theta, radius r (positive is
+      //  left, 0 is straight) for length l. true if the arc is clear
+      virtual bool test_arc(double x, double y, double theta,
+            double r, double l) = 0;
+      // distance from (x, y) along heading theta to the first cell that
+      //  isn't free, to within half a cell; range if there's none closer
+      virtual double raycast(double x, double y, double theta,
+            double range) = 0;
+
+      // goes up every time a cost anywhere in the map changes
+      virtual uint32_t stamp() const = 0;
+      // false if no cost test_arc would read for the same arc can have
+      //  changed since stamp() was since. checks per-tile stamps rather
+      //  than cells, so it's much cheaper than testing the arc again
+      virtual bool arc_changed(double x, double y, double theta,
+            double r, double l, uint32_t since) const = 0;
+      // stamp() as of the last change to tile (ti, tj)
+      virtual uint32_t tile_stamp(int ti, int tj) const = 0;
+      // copy the costs of tile (ti, tj) into out, MAP_TILE x MAP_TILE
+      //  row-major; cells past the edge of the map are 0
+      virtual void read_tile(int ti, int tj, map_type * out) = 0;
+
+      // age every obstacle by one decay step. applied lazily, per tile;
+      //  a tile's stamp moves when its decay is applied and changes a
+      //  cost, not before. decay only removes obstacles, so anything
+      //  cached against the old stamp errs on the side of blocked
+      virtual void advance_epoch() = 0;
+      // apply the decay pending in up to tiles tiles that hold evidence,
+      //  carrying on, round and round, from where the last call stopped.
+      //  false once every tile is up to date, until the next
+      //  advance_epoch. lets decay be done a little at a time by whoever
+      //  can afford it, rather than by whatever reads a tile first
+      virtual bool catch_up(int tiles) = 0;
+
+      // raw obstacle evidence at (x, y), with any pending decay applied,
+      //  without modifying the map. not safe against concurrent updates
+      virtual map_type evidence(double x, double y) const = 0;
+      // world coordinates bounding every cell that has ever held
+      //  evidence. false if none has
+      virtual bool evidence_bounds(double & x0, double & y0,
+            double & x1, double & y1) const = 0;
+      // add the obstacle evidence in from, resampled to this map's
+      //  geometry, to rows i0..i1 of this map. where this map is coarser,
+      //  each cell takes the most evidence of the cells it covers. from is
+      //  only read, but mustn't be updated meanwhile; a band of rows at a
+      //  time keeps that short while from is still in use
+      virtual void resample(const ObstacleMap & from, int i0, int i1) = 0;
+
+      // copy the size x size cells centered on the cell containing (x, y)
+      //  into out, row-major; cells off the map read as 0. (cx, cy) is set
+      //  to the world coordinates of the center cell, out[size/2][size/2]
+      virtual void read_window(double x, double y, int size, map_type * out,
+            double & cx, double & cy) = 0;
+
+      // keepout zones. cells whose centers are inside the polygon (x, y),
+      //  in world coordinates, are off limits until the next clear
+      virtual void add_keepout(const std::vector<double> & x,
+            const std::vector<double> & y) = 0;
+      virtual void clear_keepout() = 0;
+
+      // fault in the cells within r meters of (x, y) ahead of use. safe to
+      //  call from a background thread
+      virtual void prefault(double x, double y, double r) = 0;
+
+      // clear the local map and center it on the cell containing (x, y)
+      virtual void local_clear(double x, double y) = 0;
+      // world coordinates of the center of the local map
+      virtual void local_center(double & x, double & y) const = 0;
+      // mark free space from (x, y) in direction (c, s) for r meters
+      virtual void local_raytrace(double x, double y, double c, double s,
+            double r) = 0;
+      // the same for every ray, split among the threads of pool, or all on
+      //  this thread if it's NULL. each thread traces a contiguous run of
+      //  the rays (a sector, for the beams of a scan) into a local map of
+      //  its own, and those are merged into the local map after. rays only
+      //  ever mark free space, so the result is the same as tracing them
+      //  one after another
+      virtual void local_raytrace(const local_rays & rays,
+            WorkerPool * pool) = 0;
+      // mark an obstacle at (x, y)
+      virtual void local_mark(double x, double y) = 0;
+      // merge the local map into the obstacle evidence, clear the
+      //  footprint of a robot at (x, y, theta), and recomposite
+      virtual void local_merge(double x, double y, double theta) = 0;
+};
+
+#endif
@@ -0,0 +1,75 @@
+/* odom_history.h
+ *
+ * Fixed-capacity history of timestamped odometry poses, so that sensor data
+ * can be placed using the pose at the time it was measured instead of
+ * whatever pose arrived last.
+ *
+ * One writer (the odometry callback) and any number of readers; neither
+ * side takes a lock. Each slot is guarded by a sequence counter, and a
+ * reader that races with the writer lapping it simply retries or fails.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_ODOM_HISTORY_H
+#define DAGNY_ODOM_HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boost/atomic.hpp>
+
+// a 2D pose at a point in time (seconds)
+struct odom_pose {
+   double stamp;
+   double x;
+   double y;
+   double theta;
+
+   odom_pose() : stamp(0.0), x(0.0), y(0.0), theta(0.0) {}
+};
+
+class OdomHistory {
+   public:
+      // capacity is rounded up to a power of two
+      explicit OdomHistory(size_t capacity = 512,
+            double max_extrapolation = 0.1);
+      ~OdomHistory();
+
+      // add a pose; stamps must be non-decreasing
+      void push(const odom_pose & pose);
+
+      // pose at time t, interpolated between the two samples around it
+      //  poses slightly newer than the latest sample are extrapolated by up
+      //  to max_extrapolation seconds. returns false if t is older than the
+      //  history, or if the history is empty
+      bool lookup(double t, odom_pose & out) const;
+
+      // most recent pose; false if the history is empty
+      bool latest(odom_pose & out) const;
+
+   private:
+      struct slot {
+         boost::atomic<uint32_t> seq;
+         uint64_t index;
+         odom_pose pose;
+      };
+
+      // read sample number i; false if it has been overwritten
+      bool read(uint64_t i, odom_pose & out) const;
+
+      slot * slots_;
+      uint64_t mask_;
+      double max_extrapolation_;
+      // number of samples ever pushed
+      boost::atomic<uint64_t> head_;
+
+      // not copyable
+      OdomHistory(const OdomHistory &);
+      OdomHistory & operator=(const OdomHistory &);
+};
+
+// linear interpolation between two poses; f = 0 is a, f = 1 is b
+odom_pose interpolate(const odom_pose & a, const odom_pose & b, double f);
+
+#endif
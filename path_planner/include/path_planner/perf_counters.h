@@ -0,0 +1,54 @@
+/* perf_counters.h
+ *
+ * Hardware performance counters for benchmarks, through perf_event_open.
+ *
+ * Counters the kernel or CPU won't give us (no PMU, paranoid settings,
+ * not Linux) are just reported as unavailable. Only user space is counted,
+ * which is all perf_event_paranoid 2 allows without privileges. When the
+ * CPU has fewer counters than are open, the kernel multiplexes them, and
+ * the counts are scaled up by the fraction of the time each was running.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_PERF_COUNTERS_H
+#define DAGNY_PERF_COUNTERS_H
+
+#include <stdint.h>
+
+class PerfCounters {
+   public:
+      enum counter {
+         CYCLES = 0,
+         INSTRUCTIONS,
+         CACHE_MISSES,
+         BRANCH_MISSES,
+         DTLB_MISSES,
+         COUNTERS
+      };
+
+      // open every counter we can, for this thread, user space only
+      PerfCounters();
+      ~PerfCounters();
+
+      // reset and start counting
+      void start();
+      void stop();
+
+      bool available(counter c) const { return fd_[c] >= 0; }
+      // true if any counter is
+      bool any_available() const;
+      // count between the last start() and stop(); 0 if not available
+      uint64_t value(counter c) const;
+
+      static const char * name(counter c);
+
+   private:
+      int fd_[COUNTERS];
+
+      // not copyable
+      PerfCounters(const PerfCounters &);
+      PerfCounters & operator=(const PerfCounters &);
+};
+
+#endif
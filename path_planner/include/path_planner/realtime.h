@@ -0,0 +1,59 @@
+/* realtime.h
+ *
+ * Helpers for running a control thread under real-time scheduling.
+ *
+ * None of these need anything beyond POSIX and Linux; each reports why it
+ * failed (usually missing privileges: CAP_SYS_NICE, or an rtprio and
+ * memlock limit in limits.conf) so the caller can carry on without it.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_REALTIME_H
+#define DAGNY_REALTIME_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/thread/locks.hpp>
+
+// run the calling thread under SCHED_FIFO at priority (1..99)
+bool rt_set_fifo(int priority, std::string & error);
+
+// keep the calling thread on the given CPUs
+bool rt_set_affinity(const std::vector<int> & cpus, std::string & error);
+
+// lock every page the process has, and will have, into RAM
+bool rt_lock_memory(std::string & error);
+
+// touch bytes of the calling thread's stack, so it doesn't take page
+//  faults growing into it later. with memory locked, they stay resident
+void rt_prefault_stack(size_t bytes);
+
+// a mutex with priority inheritance: a thread holding it runs at the
+//  priority of the most urgent thread waiting for it, so a real-time
+//  waiter waits for the critical section, but not for whatever else would
+//  have preempted its holder. a plain mutex where the system can't do that
+class PiMutex {
+   public:
+      typedef boost::unique_lock<PiMutex> scoped_lock;
+
+      PiMutex();
+      ~PiMutex();
+
+      void lock();
+      void unlock();
+      bool try_lock();
+
+   private:
+      pthread_mutex_t mutex_;
+
+      // not copyable
+      PiMutex(const PiMutex &);
+      PiMutex & operator=(const PiMutex &);
+};
+
+#endif
@@ -0,0 +1,26 @@
+/* scan_deskew.h
+ *
+ * Per-beam laser poses for a scan taken while the robot was moving.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_SCAN_DESKEW_H
+#define DAGNY_SCAN_DESKEW_H
+
+#include <stddef.h>
+
+#include <path_planner/odom_history.h>
+
+// fill in the laser origin (x, y) and beam direction (theta) for each of the
+//  n beams in a scan, given the robot pose at the first and last beam.
+//  laser is the pose of the scanner relative to the robot.
+//
+//  a sweep takes tens of milliseconds, so the robot's motion over it is
+//  treated as linear; that makes every output linear in the beam index and
+//  the loop vectorizes cleanly
+void deskew_beams(const odom_pose & start, const odom_pose & end,
+      const odom_pose & laser, double angle_min, double angle_increment,
+      size_t n, double * x, double * y, double * theta);
+
+#endif
@@ -0,0 +1,98 @@
+/* scan_matcher.h
+ *
+ * Correlative scan-to-map matcher, for correcting odometry drift.
+ *
+ * Olson-style: the map around the robot is turned into a lookup table of
+ * how well a scan endpoint fits each cell, plus a low-resolution table
+ * holding the best fit over every block of cells. The search over
+ * (x, y, theta) scores whole blocks of translations against the low-res
+ * table first. Those scores are upper bounds, so a block can only be
+ * refined if it could beat the best full-resolution match found so far.
+ * Most of the window never gets looked at in detail.
+ *
+ * Obstacles in the map are inflated by the robot radius, so a cell's fit is
+ * its depth inside the occupied region; that peaks on the obstacle itself
+ * rather than anywhere in the inflated blob.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_SCAN_MATCHER_H
+#define DAGNY_SCAN_MATCHER_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <path_planner/mem_account.h>
+#include <path_planner/obstacle_map.h>
+#include <path_planner/odom_history.h>
+
+// rigid 2D transform: rotate by theta, then translate by (x, y)
+struct correction {
+   double x;
+   double y;
+   double theta;
+
+   correction() : x(0.0), y(0.0), theta(0.0) {}
+};
+
+// apply c to a pose
+odom_pose correct(const correction & c, const odom_pose & p);
+
+// c applied after d
+correction compose(const correction & c, const correction & d);
+
+class ScanMatcher {
+   public:
+      // size x size cell lookup tables, with block x block cell low-res
+      //  blocks
+      ScanMatcher(int size = 200, int block = 4);
+
+      // copy the map around (x, y) for the next match. the only part of
+      //  matching that reads the map, so the only part that needs it held
+      void read(ObstacleMap & map, double x, double y);
+
+      // find the correction within +/- window meters and +/- angle radians
+      //  that best fits the scan endpoints (px, py) into the map as of the
+      //  last read(). points are in the map frame, relative to the robot
+      //  at (x, y). rotations are about the robot. returns false if the
+      //  budget (s) ran out first, or there wasn't enough map to match
+      //  against
+      bool match(double x, double y,
+            const std::vector<double> & px, const std::vector<double> & py,
+            double window, double angle, double budget, correction & out);
+
+      // mean fit per point of the last match, in cells of depth; a rough
+      //  measure of how much map the scan overlapped
+      double score() const { return score_; }
+
+   private:
+      // build the lookup tables from the window
+      void build();
+
+      // sum of table over the given points, translated by offset
+      static int sum(const uint8_t * table, const std::vector<int> & pts,
+            int offset);
+
+      int size_;
+      int block_;
+      double res_;
+      // world coordinates of the center cell of the window and tables
+      double cx_;
+      double cy_;
+
+      std::vector<map_type, tagged_allocator<map_type, MEM_MATCHER> >
+         window_;
+      // full-resolution fit
+      std::vector<uint8_t> hi_;
+      // lo_[i][j] is the best fit in hi_[i..i+block)[j..j+block)
+      std::vector<uint8_t> lo_;
+
+      // table indices of the points at each rotation
+      std::vector<std::vector<int> > rotated_;
+
+      double score_;
+};
+
+#endif
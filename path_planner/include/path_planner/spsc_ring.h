@@ -0,0 +1,72 @@
+/* spsc_ring.h
+ *
+ * Fixed-capacity queue from exactly one producer thread to exactly one
+ * consumer thread. Neither side takes a lock or allocates: the producer
+ * only writes the tail index and the consumer only writes the head, so
+ * each publishes its progress to the other with one release store.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_SPSC_RING_H
+#define DAGNY_SPSC_RING_H
+
+#include <stddef.h>
+
+#include <boost/atomic.hpp>
+
+template<class T>
+class SpscRing {
+   public:
+      // capacity is rounded up to a power of two
+      explicit SpscRing(size_t capacity) : head_(0), tail_(0) {
+         size_t n = 2;
+         while( n < capacity ) n <<= 1;
+         mask_ = n - 1;
+         slots_ = new T[n];
+      }
+
+      ~SpscRing() {
+         delete [] slots_;
+      }
+
+      size_t capacity() const { return mask_ + 1; }
+
+      // producer: add item. false, and nothing added, if the ring is full
+      bool push(const T & item) {
+         const size_t t = tail_.load(boost::memory_order_relaxed);
+         if( t - head_.load(boost::memory_order_acquire) > mask_ ) {
+            return false;
+         }
+         slots_[t & mask_] = item;
+         tail_.store(t + 1, boost::memory_order_release);
+         return true;
+      }
+
+      // consumer: take the oldest item. false if there is none. the slot
+      //  is reset, so whatever it held is released on this thread
+      bool pop(T & item) {
+         const size_t h = head_.load(boost::memory_order_relaxed);
+         if( h == tail_.load(boost::memory_order_acquire) ) return false;
+         item = slots_[h & mask_];
+         slots_[h & mask_] = T();
+         head_.store(h + 1, boost::memory_order_release);
+         return true;
+      }
+
+   private:
+      T * slots_;
+      size_t mask_;
+
+      // the next slot to read and to write; they only ever go up. on
+      //  separate cache lines, so the two threads don't fight over them
+      boost::atomic<size_t> head_;
+      char pad_[64];
+      boost::atomic<size_t> tail_;
+
+      // not copyable
+      SpscRing(const SpscRing &);
+      SpscRing & operator=(const SpscRing &);
+};
+
+#endif
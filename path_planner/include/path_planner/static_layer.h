@@ -0,0 +1,107 @@
+/* static_layer.h
+ *
+ * Costmap layer for areas that are always off limits, regardless of what
+ * the sensors see.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_STATIC_LAYER_H
+#define DAGNY_STATIC_LAYER_H
+
+#include <algorithm>
+
+#include <path_planner/costmap_layer.h>
+#include <path_planner/map_alloc.h>
+
+template<class G, class Layout>
+class StaticLayer : public CostmapLayer<G, Layout> {
+   public:
+      // cells are allocated up front, but pages nobody marks are never
+      //  touched and cost no memory
+      StaticLayer(map_pages pages, int numa_node) {
+         map_alloc(Layout::cells, pages, numa_node, alloc_);
+         data_ = (uint8_t*)alloc_.data;
+      }
+
+      virtual ~StaticLayer() {
+         map_free(alloc_);
+      }
+
+      // mark cells (i, j0..j1) off limits
+      void fill_span(int i, int j0, int j1);
+
+      // unmark everything
+      void clear();
+
+      virtual void update_bounds(dirty_tiles<G::size> & d) {
+         d.include(changed_);
+         changed_.clear();
+      }
+
+      virtual void update_costs(map_type * master, const cell_bounds & b);
+
+   private:
+      enum {
+         N = G::size
+      };
+
+      map_allocation alloc_;
+      uint8_t * data_;
+
+      // every marked cell is within marked_, and in one of marked_tiles_
+      cell_bounds marked_;
+      dirty_tiles<G::size> marked_tiles_;
+      dirty_tiles<G::size> changed_;
+
+      // not copyable
+      StaticLayer(const StaticLayer &);
+      StaticLayer & operator=(const StaticLayer &);
+};
+
+template<class G, class Layout>
+void StaticLayer<G, Layout>::fill_span(int i, int j0, int j1) {
+   if( i < 0 || i >= N ) return;
+   j0 = std::max(j0, 0);
+   j1 = std::min(j1, (int)N - 1);
+   if( j0 > j1 ) return;
+   for( int j=j0; j<=j1; j++ ) {
+      data_[Layout::index(i, j)] = 1;
+   }
+   marked_.include(cell_bounds(i, j0, i, j1));
+   marked_tiles_.include(cell_bounds(i, j0, i, j1));
+   changed_.include(cell_bounds(i, j0, i, j1));
+}
+
+template<class G, class Layout>
+void StaticLayer<G, Layout>::clear() {
+   if( marked_.empty() ) return;
+   for( int i=marked_.i0; i<=marked_.i1; i++ ) {
+      for( int j=marked_.j0; j<=marked_.j1; j++ ) {
+         data_[Layout::index(i, j)] = 0;
+      }
+   }
+   changed_.include(marked_tiles_);
+   marked_ = cell_bounds();
+   marked_tiles_.clear();
+}
+
+template<class G, class Layout>
+void StaticLayer<G, Layout>::update_costs(map_type * master,
+      const cell_bounds & b) {
+   // nothing marked here; skip the sweep
+   if( marked_.empty() || b.i1 < marked_.i0 || b.i0 > marked_.i1 ||
+         b.j1 < marked_.j0 || b.j0 > marked_.j1 ) {
+      return;
+   }
+   for( int i=std::max(b.i0, marked_.i0); i<=std::min(b.i1, marked_.i1);
+         i++ ) {
+      for( int j=std::max(b.j0, marked_.j0);
+            j<=std::min(b.j1, marked_.j1); j++ ) {
+         size_t c = Layout::index(i, j);
+         if( data_[c] ) master[c] = COST_KEEPOUT;
+      }
+   }
+}
+
+#endif
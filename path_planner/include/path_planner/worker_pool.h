@@ -0,0 +1,52 @@
+/* worker_pool.h
+ *
+ * A fixed set of threads that split a job with the thread that asks for
+ * it, for work that's done often and in small pieces, where starting
+ * threads each time would cost more than the work.
+ *
+ * Author: Austin Hendrix
+ */
+
+#ifndef DAGNY_WORKER_POOL_H
+#define DAGNY_WORKER_POOL_H
+
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+class WorkerPool {
+   public:
+      // threads in all, counting the one that calls run(); threads - 1
+      //  workers are started
+      explicit WorkerPool(int threads);
+      ~WorkerPool();
+
+      int size() const { return workers_.size() + 1; }
+
+      // call job(k) for k = 0 .. n-1, each on a different thread: 0 on the
+      //  caller's, the rest on workers. returns once they're all done.
+      //  n is at most size()
+      void run(int n, const boost::function<void (int)> & job);
+
+   private:
+      void work(int k);
+
+      std::vector<boost::thread*> workers_;
+
+      boost::mutex mutex_;
+      boost::condition_variable start_;
+      boost::condition_variable done_;
+      // bumped for every job; workers run each generation once
+      unsigned generation_;
+      int n_;
+      int pending_;
+      bool stop_;
+      const boost::function<void (int)> * job_;
+
+      // not copyable
+      WorkerPool(const WorkerPool &);
+      WorkerPool & operator=(const WorkerPool &);
+};
+
+#endif
@@ -0,0 +1,123 @@
+/* arc_bench.cpp
+ *
+ * Benchmark arc-check throughput of the obstacle map, per map layout and
+ * heading. Standalone; doesn't need a ROS master.
+ *
+ * usage: arc_bench [density] [arcs] [pages]
+ *  density: fraction of cells holding an obstacle (default 0.002)
+ *  arcs:    arc checks per layout and heading (default 200000)
+ *  pages:   default, transparent or huge (default transparent)
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <path_planner/grid_map.h>
+#include <path_planner/perf_counters.h>
+
+typedef grid_geometry<5000, 100> geometry;
+
+// the planner's candidate arcs: straight, and both directions of each
+//  multiple of the minimum radius
+static const double radii[] = { 0.0, 0.695, -0.695, 1.39, -1.39, 2.78, -2.78 };
+static const int n_radii = sizeof(radii) / sizeof(radii[0]);
+static const double arc_len = 4.0;
+
+static double now() {
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// fill the map with random obstacles through the same local map path the
+//  sensors use, so the pyramid and inflation are realistic
+static void fill(ObstacleMap & map, double density, unsigned int seed) {
+   srand(seed);
+   const double res = map.resolution();
+   const double half = map.size() * res / 2.0;
+   const int local = map.local_size();
+   const double window = local * res;
+   const int marks = density * local * local;
+   for( double x = -half + window/2; x < half; x += window ) {
+      for( double y = -half + window/2; y < half; y += window ) {
+         map.local_clear(x, y);
+         for( int k=0; k<marks; k++ ) {
+            map.local_mark(x + (rand() / (double)RAND_MAX - 0.5) * window,
+                  y + (rand() / (double)RAND_MAX - 0.5) * window);
+         }
+         // footprint well off the map
+         map.local_merge(1e6, 1e6, 0.0);
+      }
+   }
+}
+
+// per-arc counter value, formatted; "n/a" if the counter isn't available
+static const char * per_arc(const PerfCounters & perf,
+      PerfCounters::counter c, int n, char * buf, size_t len) {
+   if( perf.available(c) ) {
+      snprintf(buf, len, "%8.2f", (double)perf.value(c) / n);
+   } else {
+      snprintf(buf, len, "%8s", "n/a");
+   }
+   return buf;
+}
+
+// time n arc checks from random starts with the given heading
+//  returns ns per arc; clear counts the arcs that were clear
+static double run(ObstacleMap & map, double heading, int n, int & clear,
+      PerfCounters & perf) {
+   srand(42);
+   const double span = map.size() * map.resolution() * 0.9;
+   clear = 0;
+   double start = now();
+   perf.start();
+   for( int k=0; k<n; k++ ) {
+      double x = (rand() / (double)RAND_MAX - 0.5) * span;
+      double y = (rand() / (double)RAND_MAX - 0.5) * span;
+      if( map.test_arc(x, y, heading, radii[k % n_radii], arc_len) ) {
+         ++clear;
+      }
+   }
+   perf.stop();
+   return (now() - start) * 1e9 / n;
+}
+
+template<class Layout>
+static void bench(const char * name, double density, int n,
+      map_pages pages) {
+   GridMap<geometry, Layout> map(pages);
+   fill(map, density, 1);
+   PerfCounters perf;
+   for( int deg = 0; deg < 180; deg += 45 ) {
+      int clear;
+      double ns = run(map, deg * M_PI / 180.0, n, clear, perf);
+      char tlb[32];
+      char cache[32];
+      printf("%-16s %-11s heading %3d: %8.1f ns/arc  %6.2f%% clear  "
+            "dTLB miss/arc %s  cache miss/arc %s\n", name,
+            map_pages_name(map.pages()), deg, ns, 100.0 * clear / n,
+            per_arc(perf, PerfCounters::DTLB_MISSES, n, tlb, sizeof(tlb)),
+            per_arc(perf, PerfCounters::CACHE_MISSES, n, cache,
+               sizeof(cache)));
+   }
+}
+
+int main(int argc, char ** argv) {
+   double density = argc > 1 ? atof(argv[1]) : 0.002;
+   int n = argc > 2 ? atoi(argv[2]) : 200000;
+   map_pages pages = map_pages_from_string(argc > 3 ? argv[3] :
+         "transparent");
+
+   bench<row_major_layout<geometry::size> >("row-major", density, n, pages);
+   bench<blocked_layout<geometry::size, 3, false> >("blocked 8x8",
+         density, n, pages);
+   bench<blocked_layout<geometry::size, 6, false> >("blocked 64x64",
+         density, n, pages);
+   bench<blocked_layout<geometry::size, 6, true> >("blocked 64x64 z",
+         density, n, pages);
+   return 0;
+}
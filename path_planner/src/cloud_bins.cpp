@@ -0,0 +1,63 @@
+/* cloud_bins.cpp
+ *
+ * Downsample a raw PointCloud2 buffer into 2D map cells.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <string.h>
+
+#include <path_planner/cloud_bins.h>
+#include <path_planner/grid.h>
+
+CloudBins::CloudBins(int size, double res) : size_(size), res_(res),
+   bins_(size * size, EMPTY) {
+}
+
+size_t CloudBins::bin(const uint8_t * data, const cloud_layout & layout,
+      const cloud_transform & tf, double center_x, double center_y,
+      double min_z, double max_z) {
+   const double * r = tf.r;
+   // bin coordinates are relative to the bin center, in cells
+   const double inv = 1.0 / res_;
+   const double ox = (tf.t[0] - center_x) * inv;
+   const double oy = (tf.t[1] - center_y) * inv;
+   const int half = size_ / 2;
+
+   size_t count = 0;
+   for( size_t row=0; row<layout.height; row++ ) {
+      const uint8_t * p = data + row * layout.row_step;
+      for( size_t col=0; col<layout.width; col++, p += layout.point_step ) {
+         float px, py, pz;
+         memcpy(&px, p + layout.x_offset, sizeof(float));
+         memcpy(&py, p + layout.y_offset, sizeof(float));
+         memcpy(&pz, p + layout.z_offset, sizeof(float));
+
+         double z = r[6]*px + r[7]*py + r[8]*pz + tf.t[2];
+         // also false for NaN
+         if( !(z <= max_z) ) continue;
+
+         double u = (r[0]*px + r[1]*py + r[2]*pz) * inv + ox;
+         double v = (r[3]*px + r[4]*py + r[5]*pz) * inv + oy;
+         int i = fixed_cell(to_fixed(u)) + half;
+         int j = fixed_cell(to_fixed(v)) + half;
+         if( i > 0 && j > 0 && i < size_ && j < size_ ) {
+            uint8_t cls = z >= min_z ? OBSTACLE : FLOOR;
+            uint8_t & b = bins_[i*size_ + j];
+            if( b == EMPTY ) {
+               cells_.push_back(i*size_ + j);
+            }
+            if( b < cls ) b = cls;
+            ++count;
+         }
+      }
+   }
+   return count;
+}
+
+void CloudBins::clear() {
+   for( size_t i=0; i<cells_.size(); i++ ) {
+      bins_[cells_[i]] = EMPTY;
+   }
+   cells_.clear();
+}
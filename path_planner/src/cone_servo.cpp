@@ -0,0 +1,94 @@
+/* cone_servo.cpp
+ *
+ * Steering toward a cone from camera bearings and laser cone candidates.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <math.h>
+
+#include <path_planner/cone_servo.h>
+
+static double normalize(double a) {
+   while( a > M_PI )  a -= 2.0 * M_PI;
+   while( a < -M_PI ) a += 2.0 * M_PI;
+   return a;
+}
+
+ConeServo::ConeServo(const OdomHistory & odom) : odom_(odom), gain_(1.4),
+   gate_(0.3), timeout_(1.0), have_bearing_(false), heading_(0.0),
+   have_fix_(false), fix_stamp_(0.0), fix_x_(0.0), fix_y_(0.0) {
+}
+
+void ConeServo::set_params(double gain, double gate, double timeout) {
+   gain_ = gain;
+   gate_ = gate;
+   timeout_ = timeout;
+}
+
+void ConeServo::vision(double stamp, double bearing) {
+   // frames older than the history are placed as well as we can
+   odom_pose seen;
+   if( !odom_.lookup(stamp, seen) && !odom_.latest(seen) ) return;
+   seen.stamp = stamp;
+   seen_ = seen;
+   heading_ = normalize(seen.theta + bearing);
+   have_bearing_ = true;
+
+   // a position the camera no longer agrees with was some other object
+   if( have_fix_ ) {
+      double a = atan2(fix_y_ - seen.y, fix_x_ - seen.x);
+      if( fabs(normalize(a - heading_)) > gate_ ) have_fix_ = false;
+   }
+}
+
+double ConeServo::match(double stamp, double x, double y) const {
+   if( have_bearing_ && stamp - seen_.stamp < timeout_ ) {
+      double a = atan2(y - seen_.y, x - seen_.x);
+      double e = fabs(normalize(a - heading_));
+      return e <= gate_ ? e : -1.0;
+   }
+   if( have_fix_ && stamp - fix_stamp_ < timeout_ ) {
+      double d = hypot(x - fix_x_, y - fix_y_);
+      return d <= gate_ ? d : -1.0;
+   }
+   return -1.0;
+}
+
+void ConeServo::fix(double stamp, double x, double y) {
+   have_fix_ = true;
+   fix_stamp_ = stamp;
+   fix_x_ = x;
+   fix_y_ = y;
+}
+
+bool ConeServo::position(double now, double & x, double & y) const {
+   if( !have_fix_ || now - fix_stamp_ >= timeout_ ) return false;
+   x = fix_x_;
+   y = fix_y_;
+   return true;
+}
+
+bool ConeServo::steer(const odom_pose & now, double speed,
+      double & curvature) {
+   double x;
+   double y;
+   if( position(now.stamp, x, y) ) {
+      // the arc through the cone, in the robot's frame
+      double c = cos(now.theta);
+      double s = sin(now.theta);
+      double lx = c * (x - now.x) + s * (y - now.y);
+      double ly = c * (y - now.y) - s * (x - now.x);
+      double d2 = lx*lx + ly*ly;
+      curvature = d2 > 1e-6 ? 2.0 * ly / d2 : 0.0;
+      return true;
+   }
+   if( have_bearing_ && now.stamp - seen_.stamp < timeout_ ) {
+      // the bearing as it would be seen from here; without a range the
+      //  robot's travel since the frame can't be taken out, only its turn
+      double b = normalize(heading_ - now.theta);
+      curvature = speed > 0.0 ? gain_ * b / speed : 0.0;
+      return true;
+   }
+   return false;
+}
@@ -0,0 +1,106 @@
+/* keepout.cpp
+ *
+ * Keepout zones: loading, and scanline rasterization.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <math.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <path_planner/keepout.h>
+
+bool load_keepout_file(const std::string & path,
+      std::vector<keepout_zone> & zones, std::string & error) {
+   std::ifstream in(path.c_str());
+   if( !in ) {
+      error = "cannot open " + path;
+      return false;
+   }
+
+   std::string line;
+   int n = 0;
+   while( std::getline(in, line) ) {
+      ++n;
+      std::istringstream fields(line);
+      std::string frame;
+      if( !(fields >> frame) || frame[0] == '#' ) continue;
+
+      std::ostringstream where;
+      where << path << ":" << n << ": ";
+
+      keepout_zone zone;
+      if( frame == "utm" ) {
+         zone.utm = true;
+      } else if( frame == "odom" ) {
+         zone.utm = false;
+      } else {
+         error = where.str() + "unknown frame " + frame;
+         return false;
+      }
+      double x;
+      double y;
+      while( fields >> x ) {
+         if( !(fields >> y) ) {
+            error = where.str() + "odd number of coordinates";
+            return false;
+         }
+         zone.x.push_back(x);
+         zone.y.push_back(y);
+      }
+      if( !fields.eof() ) {
+         error = where.str() + "bad coordinate";
+         return false;
+      }
+      if( zone.x.size() < 3 ) {
+         error = where.str() + "a zone needs at least three points";
+         return false;
+      }
+      zones.push_back(zone);
+   }
+   return true;
+}
+
+void scanline_fill(const std::vector<double> & u,
+      const std::vector<double> & v, int size,
+      std::vector<cell_span> & spans) {
+   const size_t n = u.size();
+   if( n < 3 ) return;
+
+   double lo = u[0];
+   double hi = u[0];
+   for( size_t k=1; k<n; k++ ) {
+      lo = std::min(lo, u[k]);
+      hi = std::max(hi, u[k]);
+   }
+   const int i0 = std::max((int)ceil(lo), 0);
+   const int i1 = std::min((int)floor(hi), size - 1);
+
+   std::vector<double> cross;
+   for( int i=i0; i<=i1; i++ ) {
+      // where the edges cross this row's center line. each edge counts
+      //  from its lower end up to, but not including, its upper end, so a
+      //  vertex on the line isn't counted twice
+      cross.clear();
+      for( size_t a=0; a<n; a++ ) {
+         size_t b = (a + 1) % n;
+         if( (u[a] <= i && i < u[b]) || (u[b] <= i && i < u[a]) ) {
+            double f = (i - u[a]) / (u[b] - u[a]);
+            cross.push_back(v[a] + f * (v[b] - v[a]));
+         }
+      }
+      std::sort(cross.begin(), cross.end());
+
+      // cells whose centers are between each pair of crossings
+      for( size_t k=0; k+1<cross.size(); k += 2 ) {
+         cell_span s;
+         s.i = i;
+         s.j0 = std::max((int)ceil(cross[k]), 0);
+         s.j1 = std::min((int)floor(cross[k+1]), size - 1);
+         if( s.j0 <= s.j1 ) spans.push_back(s);
+      }
+   }
+}
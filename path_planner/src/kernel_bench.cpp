@@ -0,0 +1,398 @@
+/* kernel_bench.cpp
+ *
+ * Hardware counters for each of the planner's map kernels, as JSON, and a
+ * comparison of two such runs. Standalone; doesn't need a ROS master.
+ *
+ * usage: kernel_bench [scale] [pages] > run.json
+ *        kernel_bench compare before.json after.json
+ *  scale: multiplies the operations run per kernel (default 1.0)
+ *  pages: default, transparent or huge (default transparent)
+ *
+ * Counters that can't be opened come out as null; with none at all, which
+ * is what a perf_event_paranoid above 2 or a VM without a PMU gives, the
+ * run is timing only.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <path_planner/keepout.h>
+#include <path_planner/obstacle_map.h>
+#include <path_planner/perf_counters.h>
+
+static double now() {
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static double uniform() {
+   return rand() / (double)RAND_MAX - 0.5;
+}
+
+// everything the kernels work on
+struct bench_state {
+   ObstacleMap * map;
+   // the beams of a 270 degree, 1081 beam scan
+   local_rays scan;
+   // where the robot is, for the footprint the merge clears
+   double robot_x;
+   double robot_y;
+   // cells set by the last inflate operation
+   std::vector<double> set_x;
+   std::vector<double> set_y;
+   std::vector<map_type> set_v;
+   // a keepout polygon, in cells
+   std::vector<double> poly_u;
+   std::vector<double> poly_v;
+   std::vector<cell_span> spans;
+   int clear;
+};
+
+// the planner's candidate arcs; see arc_bench.cpp
+static const double radii[] = { 0.0, 0.695, -0.695, 1.39, -1.39, 2.78, -2.78 };
+static const int n_radii = sizeof(radii) / sizeof(radii[0]);
+
+// a random start within the middle of the map
+static void random_start(bench_state & s, double & x, double & y) {
+   const double span = s.map->size() * s.map->resolution() * 0.9;
+   x = uniform() * span;
+   y = uniform() * span;
+}
+
+static void test_arc_op(bench_state & s, int k) {
+   double x;
+   double y;
+   random_start(s, x, y);
+   if( s.map->test_arc(x, y, (k % 8) * M_PI / 4.0, radii[k % n_radii],
+            4.0) ) {
+      ++s.clear;
+   }
+}
+
+static void raycast_op(bench_state & s, int k) {
+   double x;
+   double y;
+   random_start(s, x, y);
+   if( s.map->raycast(x, y, (k % 16) * M_PI / 8.0, 8.0) >= 8.0 ) ++s.clear;
+}
+
+// the beams of scan k from a robot driving at 1m/s, scanning at 10Hz. the
+//  footprint's changes span its old and new place, so a robot jumping
+//  about would make every merge composite most of the map
+static void raytrace_prepare(bench_state & s, int k) {
+   const double x = -200.0 + 0.1 * k;
+   const double y = 10.0 * sin(0.01 * k);
+   s.map->local_clear(x, y);
+   s.robot_x = x;
+   s.robot_y = y;
+   for( size_t b=0; b<s.scan.size(); b++ ) {
+      s.scan[b].x = x;
+      s.scan[b].y = y;
+   }
+}
+
+static void raytrace_op(bench_state & s, int) {
+   s.map->local_raytrace(s.scan, NULL);
+}
+
+// a scan's beams and the obstacles at their ends, ready to merge
+static void merge_prepare(bench_state & s, int k) {
+   raytrace_prepare(s, k);
+   s.map->local_raytrace(s.scan, NULL);
+   for( size_t b=0; b<s.scan.size(); b += 8 ) {
+      const local_ray & ray = s.scan[b];
+      s.map->local_mark(ray.x + ray.c * ray.r, ray.y + ray.s * ray.r);
+   }
+}
+
+static void merge_op(bench_state & s, int) {
+   s.map->local_merge(s.robot_x, s.robot_y, 0.0);
+}
+
+// alternately add a cluster of obstacles and take it away again, so each
+//  operation is one batch of inflation flips
+static void inflate_op(bench_state & s, int k) {
+   if( k % 2 == 0 ) {
+      double x;
+      double y;
+      random_start(s, x, y);
+      for( size_t c=0; c<s.set_x.size(); c++ ) {
+         s.set_x[c] = x + uniform() * 2.0;
+         s.set_y[c] = y + uniform() * 2.0;
+      }
+   }
+   std::fill(s.set_v.begin(), s.set_v.end(), k % 2 == 0 ? 4 : 0);
+   s.map->set(s.set_x, s.set_y, s.set_v);
+}
+
+static void keepout_op(bench_state & s, int) {
+   s.spans.clear();
+   scanline_fill(s.poly_u, s.poly_v, s.map->size(), s.spans);
+}
+
+struct kernel {
+   const char * name;
+   // operations run, at scale 1
+   int ops;
+   // run before each operation, outside of the measurement, or NULL
+   void (*prepare)(bench_state &, int);
+   void (*op)(bench_state &, int);
+};
+
+static const kernel kernels[] = {
+   { "test_arc", 200000, NULL, test_arc_op },
+   { "raycast",  200000, NULL, raycast_op },
+   { "raytrace", 2000, raytrace_prepare, raytrace_op },
+   { "merge",    500, merge_prepare, merge_op },
+   { "inflate",  2000, NULL, inflate_op },
+   { "keepout",  2000, NULL, keepout_op },
+};
+static const int n_kernels = sizeof(kernels) / sizeof(kernels[0]);
+
+// fill the map with random obstacles through the local map, as arc_bench
+//  does. the footprint is in the middle of each window, as the robot's is;
+//  one off the map would stretch every composite out to the map's edge
+static void fill(ObstacleMap & map, double density) {
+   srand(1);
+   const double res = map.resolution();
+   const double half = map.size() * res / 2.0;
+   const int local = map.local_size();
+   const double window = local * res;
+   const int marks = density * local * local;
+   for( double x = -half + window/2; x < half; x += window ) {
+      for( double y = -half + window/2; y < half; y += window ) {
+         map.local_clear(x, y);
+         for( int k=0; k<marks; k++ ) {
+            map.local_mark(x + uniform() * window, y + uniform() * window);
+         }
+         map.local_merge(x, y, 0.0);
+      }
+   }
+}
+
+// run kernel k and print its JSON object
+static void bench(bench_state & s, const kernel & k, double scale,
+      PerfCounters & perf, bool last) {
+   const int n = std::max(1, (int)(k.ops * scale));
+   uint64_t counts[PerfCounters::COUNTERS] = { 0 };
+   double elapsed = 0.0;
+
+   srand(42);
+   s.clear = 0;
+   if( k.prepare ) {
+      // counters are read after every operation, so the preparation isn't
+      //  counted
+      for( int i=0; i<n; i++ ) {
+         k.prepare(s, i);
+         double start = now();
+         perf.start();
+         k.op(s, i);
+         perf.stop();
+         elapsed += now() - start;
+         for( int c=0; c<PerfCounters::COUNTERS; c++ ) {
+            counts[c] += perf.value((PerfCounters::counter)c);
+         }
+      }
+   } else {
+      double start = now();
+      perf.start();
+      for( int i=0; i<n; i++ ) k.op(s, i);
+      perf.stop();
+      elapsed = now() - start;
+      for( int c=0; c<PerfCounters::COUNTERS; c++ ) {
+         counts[c] = perf.value((PerfCounters::counter)c);
+      }
+   }
+
+   printf("    { \"name\": \"%s\", \"ops\": %d, \"ns\": %.2f", k.name, n,
+         elapsed * 1e9 / n);
+   for( int c=0; c<PerfCounters::COUNTERS; c++ ) {
+      PerfCounters::counter pc = (PerfCounters::counter)c;
+      if( perf.available(pc) ) {
+         printf(", \"%s\": %.3f", PerfCounters::name(pc),
+               (double)counts[c] / n);
+      } else {
+         printf(", \"%s\": null", PerfCounters::name(pc));
+      }
+   }
+   printf(" }%s\n", last ? "" : ",");
+}
+
+static int run(double scale, map_pages pages) {
+   bench_state s;
+   s.map = ObstacleMap::create(5000, 0.1, pages);
+   if( !s.map ) {
+      fprintf(stderr, "no map for 5000 cells at 0.1m\n");
+      return 1;
+   }
+   fill(*s.map, 0.002);
+
+   for( int b=0; b<1081; b++ ) {
+      local_ray ray;
+      double theta = -0.75 * M_PI + b * 1.5 * M_PI / 1080;
+      ray.x = 0.0;
+      ray.y = 0.0;
+      ray.c = cos(theta);
+      ray.s = sin(theta);
+      ray.r = 2.0 + 5.0 * (b % 37) / 37.0;
+      s.scan.push_back(ray);
+   }
+   s.set_x.resize(64);
+   s.set_y.resize(64);
+   s.set_v.resize(64);
+   // a 12-sided zone 200 cells across, in the middle of the map
+   for( int v=0; v<12; v++ ) {
+      double a = v * M_PI / 6.0;
+      double r = v % 2 ? 100.0 : 70.0;
+      s.poly_u.push_back(s.map->size() / 2 + r * cos(a));
+      s.poly_v.push_back(s.map->size() / 2 + r * sin(a));
+   }
+
+   PerfCounters perf;
+   if( !perf.any_available() ) {
+      fprintf(stderr, "no performance counters (see "
+            "/proc/sys/kernel/perf_event_paranoid); timing only\n");
+   }
+
+   printf("{\n  \"pages\": \"%s\",\n  \"kernels\": [\n",
+         map_pages_name(s.map->pages()));
+   for( int k=0; k<n_kernels; k++ ) {
+      bench(s, kernels[k], scale, perf, k == n_kernels - 1);
+   }
+   printf("  ]\n}\n");
+   delete s.map;
+   return 0;
+}
+
+// one kernel's results from a run: metric names and their values per
+//  operation. null values are left out
+struct result {
+   std::string name;
+   std::vector<std::string> keys;
+   std::vector<double> values;
+};
+
+// read the kernels from a run. only reads what run() writes: an object
+//  per kernel, with a name and flat numeric members
+static bool load(const char * path, std::vector<result> & results) {
+   FILE * f = fopen(path, "r");
+   if( !f ) {
+      fprintf(stderr, "cannot open %s\n", path);
+      return false;
+   }
+   std::string text;
+   char buf[4096];
+   size_t len;
+   while( (len = fread(buf, 1, sizeof(buf), f)) > 0 ) text.append(buf, len);
+   fclose(f);
+
+   size_t at = 0;
+   while( (at = text.find("\"name\":", at)) != std::string::npos ) {
+      size_t q0 = text.find('"', at + 7);
+      size_t q1 = q0 == std::string::npos ? q0 : text.find('"', q0 + 1);
+      size_t end = text.find('}', at);
+      if( q1 == std::string::npos || end == std::string::npos ) break;
+      result r;
+      r.name = text.substr(q0 + 1, q1 - q0 - 1);
+      for( size_t k = text.find('"', q1 + 1); k < end;
+            k = text.find('"', k + 1) ) {
+         size_t k1 = text.find('"', k + 1);
+         const char * v = text.c_str() + text.find(':', k1) + 1;
+         char * stop;
+         double d = strtod(v, &stop);
+         if( stop != v ) {
+            r.keys.push_back(text.substr(k + 1, k1 - k - 1));
+            r.values.push_back(d);
+         }
+         k = text.find(',', k1);
+         if( k == std::string::npos ) k = end;
+      }
+      results.push_back(r);
+      at = end;
+   }
+   if( results.empty() ) {
+      fprintf(stderr, "no kernels in %s\n", path);
+      return false;
+   }
+   return true;
+}
+
+static int compare(const char * before_path, const char * after_path) {
+   std::vector<result> before;
+   std::vector<result> after;
+   if( !load(before_path, before) || !load(after_path, after) ) return 1;
+
+   printf("%-10s %-18s %14s %14s %9s\n", "kernel", "per op", "before",
+         "after", "change");
+   for( size_t a=0; a<after.size(); a++ ) {
+      const result * b = NULL;
+      for( size_t i=0; i<before.size(); i++ ) {
+         if( before[i].name == after[a].name ) b = &before[i];
+      }
+      if( !b ) {
+         printf("%-10s only in %s\n", after[a].name.c_str(), after_path);
+         continue;
+      }
+      for( size_t k=0; k<after[a].keys.size(); k++ ) {
+         const std::string & key = after[a].keys[k];
+         if( key == "ops" ) continue;
+         for( size_t i=0; i<b->keys.size(); i++ ) {
+            if( b->keys[i] != key ) continue;
+            double was = b->values[i];
+            double is = after[a].values[k];
+            if( was != 0.0 ) {
+               printf("%-10s %-18s %14.2f %14.2f %+8.1f%%\n",
+                     after[a].name.c_str(), key.c_str(), was, is,
+                     100.0 * (is - was) / was);
+            } else {
+               printf("%-10s %-18s %14.2f %14.2f %9s\n",
+                     after[a].name.c_str(), key.c_str(), was, is, "");
+            }
+         }
+      }
+   }
+   return 0;
+}
+
+static int usage(const char * name) {
+   fprintf(stderr, "usage: %s [scale] [pages] > run.json\n"
+         "       %s compare before.json after.json\n"
+         "  scale: multiplies the operations run per kernel (default 1.0)\n"
+         "  pages: default, transparent or huge (default transparent)\n",
+         name, name);
+   return 1;
+}
+
+int main(int argc, char ** argv) {
+   if( argc > 1 && strcmp(argv[1], "compare") == 0 ) {
+      if( argc != 4 ) return usage(argv[0]);
+      return compare(argv[2], argv[3]);
+   }
+   if( argc > 3 ) return usage(argv[0]);
+   double scale = 1.0;
+   if( argc > 1 ) {
+      char * end;
+      scale = strtod(argv[1], &end);
+      if( end == argv[1] || *end != '\0' || !(scale > 0.0) ||
+            !isfinite(scale) ) {
+         return usage(argv[0]);
+      }
+   }
+   const char * pages_name = argc > 2 ? argv[2] : "transparent";
+   map_pages pages = map_pages_from_string(pages_name);
+   // anything unknown reads as default pages
+   if( strcmp(map_pages_name(pages), pages_name) != 0 ) {
+      return usage(argv[0]);
+   }
+   return run(scale, pages);
+}
@@ -0,0 +1,70 @@
+/* latency_stats.cpp
+ *
+ * Latency histogram for a real-time thread to record into and another
+ * thread to report from.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <path_planner/latency_stats.h>
+
+// values under 8 have a bucket each; above that, eight per power of two
+static int bucket(uint64_t us) {
+   if( us < 8 ) return us;
+   int msb = 63 - __builtin_clzll(us);
+   int b = (msb - 2) * 8 + ((us >> (msb - 3)) & 7);
+   return b < LATENCY_BUCKETS ? b : LATENCY_BUCKETS - 1;
+}
+
+// the largest value that lands in bucket b
+static double bucket_top(int b) {
+   if( b < 8 ) return b;
+   int msb = b / 8 + 2;
+   uint64_t low = (uint64_t)(8 + b % 8) << (msb - 3);
+   return low + ((uint64_t)1 << (msb - 3)) - 1;
+}
+
+// the top of the bucket holding the sample at fraction p of the way
+//  through the n in counts
+static double percentile(const uint32_t * counts, uint64_t n, double p) {
+   if( n == 0 ) return 0.0;
+   const uint64_t rank = p * (n - 1);
+   uint64_t seen = 0;
+   for( int b=0; b<LATENCY_BUCKETS; b++ ) {
+      seen += counts[b];
+      if( seen > rank ) return bucket_top(b);
+   }
+   return bucket_top(LATENCY_BUCKETS - 1);
+}
+
+LatencyStats::LatencyStats() : max_us_(0) {
+   for( int b=0; b<LATENCY_BUCKETS; b++ ) buckets_[b].store(0);
+}
+
+void LatencyStats::record(double seconds) {
+   uint64_t us = seconds > 0.0 ? (uint64_t)(seconds * 1e6) : 0;
+   buckets_[bucket(us)].fetch_add(1, boost::memory_order_relaxed);
+   uint64_t max = max_us_.load(boost::memory_order_relaxed);
+   while( us > max && !max_us_.compare_exchange_weak(max, us,
+            boost::memory_order_relaxed) ) {
+   }
+}
+
+latency_summary LatencyStats::take() {
+   uint32_t counts[LATENCY_BUCKETS];
+   latency_summary s;
+   s.count = 0;
+   for( int b=0; b<LATENCY_BUCKETS; b++ ) {
+      counts[b] = buckets_[b].exchange(0, boost::memory_order_relaxed);
+      s.count += counts[b];
+   }
+   s.max = max_us_.exchange(0, boost::memory_order_relaxed);
+   s.p50 = percentile(counts, s.count, 0.5);
+   s.p99 = percentile(counts, s.count, 0.99);
+   s.p999 = percentile(counts, s.count, 0.999);
+   // no bucket edge is past the longest sample
+   if( s.p50 > s.max ) s.p50 = s.max;
+   if( s.p99 > s.max ) s.p99 = s.max;
+   if( s.p999 > s.max ) s.p999 = s.max;
+   return s;
+}
@@ -0,0 +1,150 @@
+/* map_alloc.cpp
+ *
+ * Page-aware allocation for the obstacle map.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <path_planner/map_alloc.h>
+#include <path_planner/mem_account.h>
+
+#define HUGE_PAGE (2UL << 20)
+
+// not in every libc's headers
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+#define MPOL_PREFERRED 1
+
+static size_t round_up(size_t n, size_t align) {
+   return (n + align - 1) & ~(align - 1);
+}
+
+// prefer numa_node for the pages in [p, p + bytes). must be called before
+//  they're faulted in. best effort; without NUMA it's a no-op
+static void prefer_node(void * p, size_t bytes, int numa_node) {
+#ifdef SYS_mbind
+   if( numa_node < 0 || numa_node >= (int)(8 * sizeof(unsigned long)) ) {
+      return;
+   }
+   unsigned long mask = 1UL << numa_node;
+   syscall(SYS_mbind, p, bytes, MPOL_PREFERRED, &mask,
+         8 * sizeof(unsigned long), 0);
+#endif
+}
+
+static bool alloc_huge(size_t bytes, map_allocation & out) {
+   size_t len = round_up(bytes, HUGE_PAGE);
+   void * p = mmap(0, len, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+   if( p == MAP_FAILED ) return false;
+   out.data = p;
+   out.bytes = len;
+   out.pages = PAGES_HUGE;
+   return true;
+}
+
+static bool alloc_transparent(size_t bytes, map_allocation & out) {
+   // over-allocate so we can trim to a 2MB-aligned range; the kernel only
+   //  backs aligned 2MB extents with huge pages
+   size_t len = round_up(bytes, HUGE_PAGE);
+   size_t span = len + HUGE_PAGE;
+   void * p = mmap(0, span, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if( p == MAP_FAILED ) return false;
+
+   uintptr_t start = (uintptr_t)p;
+   uintptr_t aligned = round_up(start, HUGE_PAGE);
+   if( aligned > start ) {
+      munmap(p, aligned - start);
+   }
+   uintptr_t end = aligned + len;
+   if( start + span > end ) {
+      munmap((void*)end, start + span - end);
+   }
+
+   out.data = (void*)aligned;
+   out.bytes = len;
+   out.pages = madvise(out.data, len, MADV_HUGEPAGE) == 0 ?
+      PAGES_TRANSPARENT : PAGES_DEFAULT;
+   return true;
+}
+
+static bool alloc_default(size_t bytes, map_allocation & out) {
+   size_t len = round_up(bytes, sysconf(_SC_PAGESIZE));
+   void * p = mmap(0, len, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if( p == MAP_FAILED ) return false;
+   out.data = p;
+   out.bytes = len;
+   out.pages = PAGES_DEFAULT;
+   return true;
+}
+
+bool map_alloc(size_t bytes, map_pages pages, int numa_node,
+      map_allocation & out) {
+   bool ok = (pages >= PAGES_HUGE && alloc_huge(bytes, out)) ||
+      (pages >= PAGES_TRANSPARENT && alloc_transparent(bytes, out)) ||
+      alloc_default(bytes, out);
+   if( !ok ) {
+      out.data = 0;
+      out.bytes = 0;
+      return false;
+   }
+   prefer_node(out.data, out.bytes, numa_node);
+   mem_allocated(MEM_MAP, out.bytes);
+   return true;
+}
+
+void map_free(map_allocation & a) {
+   if( a.data ) {
+      munmap(a.data, a.bytes);
+      mem_freed(MEM_MAP, a.bytes);
+   }
+   a.data = 0;
+   a.bytes = 0;
+}
+
+void map_prefault(const void * p, size_t bytes) {
+   const size_t page = sysconf(_SC_PAGESIZE);
+   uintptr_t start = (uintptr_t)p & ~(page - 1);
+   uintptr_t end = round_up((uintptr_t)p + bytes, page);
+   if( madvise((void*)start, end - start, MADV_POPULATE_WRITE) == 0 ) {
+      return;
+   }
+   // older kernels: write-fault each page with an atomic no-op, so a
+   //  concurrent store from the map's owner can't be lost
+   for( uintptr_t a = round_up((uintptr_t)p, page); a < (uintptr_t)p + bytes;
+         a += page ) {
+      __sync_fetch_and_or((volatile char*)a, 0);
+   }
+}
+
+map_pages map_pages_from_string(const char * s) {
+   if( strcmp(s, "huge") == 0 ) return PAGES_HUGE;
+   if( strcmp(s, "transparent") == 0 ) return PAGES_TRANSPARENT;
+   return PAGES_DEFAULT;
+}
+
+const char * map_pages_name(map_pages pages) {
+   switch( pages ) {
+      case PAGES_HUGE:
+         return "huge";
+      case PAGES_TRANSPARENT:
+         return "transparent";
+      default:
+         return "default";
+   }
+}
@@ -0,0 +1,283 @@
+/* map_check.cpp
+ *
+ * Self-checks for the map code that's easy to get subtly wrong: the
+ * parallel raytrace against the serial one, the map stream's run-length
+ * codec, and the map share's batch parser. Standalone; doesn't need a ROS
+ * master.
+ *
+ * usage: map_check
+ *
+ * Prints each check as it runs, and exits 1 if any failed.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include <path_planner/byte_io.h>
+#include <path_planner/map_share.h>
+#include <path_planner/map_stream.h>
+#include <path_planner/obstacle_map.h>
+#include <path_planner/worker_pool.h>
+
+static int failures = 0;
+
+static void check(bool ok, const char * what) {
+   printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+   if( !ok ) ++failures;
+}
+
+static double uniform() {
+   return rand() / (double)RAND_MAX - 0.5;
+}
+
+// a scan of beams from (x, y), some ending short on an obstacle
+static void random_scan(double x, double y, local_rays & rays,
+      std::vector<double> & hit_x, std::vector<double> & hit_y) {
+   rays.clear();
+   hit_x.clear();
+   hit_y.clear();
+   for( int b=0; b<1081; b++ ) {
+      const double theta = (b - 540) * (1.5 * M_PI / 1080);
+      const double r = 2.0 + 4.0 * (uniform() + 0.5);
+      local_ray ray = { x, y, cos(theta), sin(theta), r };
+      rays.push_back(ray);
+      if( b % 7 == 0 ) {
+         hit_x.push_back(x + r * ray.c);
+         hit_y.push_back(y + r * ray.s);
+      }
+   }
+}
+
+// the same scans traced serially and on a pool must leave the same
+//  evidence, on top of the same obstacles
+static void check_parallel_raytrace() {
+   ObstacleMap * serial = ObstacleMap::create(2500, 0.10, PAGES_DEFAULT);
+   ObstacleMap * parallel = ObstacleMap::create(2500, 0.10, PAGES_DEFAULT);
+   WorkerPool pool(4);
+
+   srand(1);
+   std::vector<double> x;
+   std::vector<double> y;
+   std::vector<map_type> v;
+   for( int k=0; k<2000; k++ ) {
+      x.push_back(uniform() * 20.0);
+      y.push_back(uniform() * 20.0);
+      v.push_back(4);
+   }
+   serial->set(x, y, v);
+   parallel->set(x, y, v);
+
+   local_rays rays;
+   std::vector<double> hit_x;
+   std::vector<double> hit_y;
+   for( int scan=0; scan<20; scan++ ) {
+      const double sx = uniform() * 4.0;
+      const double sy = uniform() * 4.0;
+      random_scan(sx, sy, rays, hit_x, hit_y);
+      ObstacleMap * maps[2] = { serial, parallel };
+      for( int m=0; m<2; m++ ) {
+         maps[m]->local_clear(sx, sy);
+         maps[m]->local_raytrace(rays, m == 0 ? NULL : &pool);
+         for( size_t h=0; h<hit_x.size(); h++ ) {
+            maps[m]->local_mark(hit_x[h], hit_y[h]);
+         }
+         maps[m]->local_merge(sx, sy, 0.0);
+      }
+   }
+
+   int differ = 0;
+   const double res = serial->resolution();
+   for( double cx = -12.0; cx <= 12.0; cx += res ) {
+      for( double cy = -12.0; cy <= 12.0; cy += res ) {
+         if( serial->evidence(cx, cy) != parallel->evidence(cx, cy) ) {
+            ++differ;
+         }
+      }
+   }
+   check(differ == 0, "parallel raytrace leaves the same evidence");
+
+   delete serial;
+   delete parallel;
+}
+
+static bool round_trip(const std::vector<map_type> & cells) {
+   std::vector<uint8_t> runs;
+   map_stream_encode_runs(&cells[0], cells.size(), runs);
+   std::vector<map_type> out(cells.size(), 3);
+   return map_stream_decode_runs(&runs[0], runs.size(), &out[0],
+         out.size()) && out == cells;
+}
+
+static void check_stream_runs() {
+   const size_t n = MAP_TILE * MAP_TILE;
+   std::vector<map_type> cells(n, 0);
+   check(round_trip(cells), "stream runs: an empty tile round-trips");
+
+   // runs of every length about the short/long boundary, and a long one
+   //  that needs a multi-byte varint
+   bool ok = true;
+   for( size_t len=1; len<200 && ok; len++ ) {
+      std::fill(cells.begin(), cells.end(), 0);
+      std::fill(cells.begin() + 100, cells.begin() + 100 + len, 2);
+      ok = round_trip(cells);
+   }
+   std::fill(cells.begin(), cells.end(), 1);
+   cells[n - 1] = 3;
+   ok = ok && round_trip(cells);
+   check(ok, "stream runs: runs of every length round-trip");
+
+   srand(2);
+   ok = true;
+   for( int t=0; t<100 && ok; t++ ) {
+      for( size_t k=0; k<n; k++ ) {
+         cells[k] = rand() % 16 == 0 ? rand() % 4 : cells[k ? k - 1 : 0];
+      }
+      ok = round_trip(cells);
+   }
+   check(ok, "stream runs: random tiles round-trip");
+
+   std::vector<uint8_t> runs;
+   std::fill(cells.begin(), cells.end(), 0);
+   cells[7] = 1;
+   map_stream_encode_runs(&cells[0], n, runs);
+   std::vector<map_type> out(n);
+
+   check(!map_stream_decode_runs(&runs[0], runs.size() - 1, &out[0], n),
+         "stream runs: truncated runs are refused");
+   check(!map_stream_decode_runs(&runs[0], runs.size(), &out[0], n - 1),
+         "stream runs: runs past the end of the tile are refused");
+   check(!map_stream_decode_runs(&runs[0], runs.size(), &out[0], n + 1),
+         "stream runs: runs short of the tile are refused");
+
+   // a long run whose varint never ends
+   std::vector<uint8_t> bad;
+   bad.push_back(63 << 2);
+   bad.push_back(0x80);
+   bad.push_back(0x80);
+   check(!map_stream_decode_runs(&bad[0], bad.size(), &out[0], n),
+         "stream runs: an unterminated varint is refused");
+   // one that goes on longer than any run could be
+   bad.resize(1);
+   for( int k=0; k<6; k++ ) bad.push_back(0xff);
+   bad.push_back(0x01);
+   check(!map_stream_decode_runs(&bad[0], bad.size(), &out[0], n),
+         "stream runs: an overlong varint is refused");
+}
+
+// a batch from robot in session, at res, with one delta setting the given
+//  cells
+static std::vector<uint8_t> share_batch(uint32_t robot, uint32_t session,
+      float res, int32_t ti, int32_t tj, uint32_t version,
+      const std::vector<int> & index, map_type value) {
+   std::vector<uint8_t> b;
+   put_u32(b, robot);
+   put_u32(b, session);
+   put_f32(b, res);
+   put_u16(b, 1);
+   put_u32(b, ti);
+   put_u32(b, tj);
+   put_u32(b, version);
+   put_u16(b, index.size());
+   for( size_t k=0; k<index.size(); k++ ) {
+      put_u16(b, index[k]);
+      b.push_back(value);
+   }
+   return b;
+}
+
+static void check_share_batches() {
+   ObstacleMap * a = ObstacleMap::create(2500, 0.10, PAGES_DEFAULT);
+   ObstacleMap * b = ObstacleMap::create(2500, 0.10, PAGES_DEFAULT);
+   LoopbackTransport ta;
+   LoopbackTransport tb;
+   LoopbackTransport forger;
+   ta.connect(tb);
+   forger.connect(tb);
+   MapShare sa(1, ta);
+   MapShare sb(2, tb);
+   share_frame frame;
+
+   // round trip: what one robot sees, the other gets
+   a->set(3.0, 4.0, 4);
+   a->set(-7.5, 2.2, 3);
+   sa.send(*a, frame, 10000);
+   const int applied = sb.receive(*b, frame);
+   check(applied > 0 && b->evidence(3.0, 4.0) == 4 &&
+         b->evidence(-7.5, 2.2) == 3 && sb.rejected() == 0,
+         "share: evidence sent is applied by the other robot");
+
+   // shared tile 0, 0, cell 5, 5 is at (0.5, 0.5) in a frame at the origin
+   std::vector<int> cell(1, 5 * MAP_TILE + 5);
+   std::vector<uint8_t> good = share_batch(3, 7, 0.10f, 0, 0, 1, cell, 4);
+
+   uint64_t rejected = sb.rejected();
+   forger.send(std::vector<uint8_t>());
+   for( size_t len=1; len<good.size(); len++ ) {
+      forger.send(std::vector<uint8_t>(good.begin(), good.begin() + len));
+   }
+   sb.receive(*b, frame);
+   check(sb.rejected() == rejected + good.size() &&
+         b->evidence(0.5, 0.5) == 0,
+         "share: empty and truncated batches are refused");
+
+   rejected = sb.rejected();
+   forger.send(share_batch(3, 7, 0.20f, 0, 0, 1, cell, 4));
+   sb.receive(*b, frame);
+   check(sb.rejected() == rejected + 1 && b->evidence(0.5, 0.5) == 0,
+         "share: batches at another resolution are refused");
+
+   // a delta claiming more cells than the batch holds
+   std::vector<uint8_t> lying = good;
+   lying[4 + 4 + 4 + 2 + 12] = 200;
+   rejected = sb.rejected();
+   forger.send(lying);
+   sb.receive(*b, frame);
+   check(sb.rejected() == rejected + 1 && b->evidence(0.5, 0.5) == 0,
+         "share: a cell count past the end of the batch is refused");
+
+   // cells outside the tile are skipped, the rest applied
+   std::vector<int> cells;
+   cells.push_back(MAP_TILE * MAP_TILE);
+   cells.push_back(0xffff);
+   cells.push_back(5 * MAP_TILE + 5);
+   forger.send(share_batch(3, 7, 0.10f, 0, 0, 1, cells, 4));
+   sb.receive(*b, frame);
+   check(b->evidence(0.5, 0.5) == 4,
+         "share: cells outside the tile are skipped");
+
+   // a replay of an applied version does nothing
+   const uint64_t stale = sb.stale();
+   forger.send(share_batch(3, 7, 0.10f, 0, 0, 1, cell, 0));
+   sb.receive(*b, frame);
+   check(sb.stale() == stale + 1 && b->evidence(0.5, 0.5) == 4,
+         "share: replayed deltas are dropped");
+
+   // the same robot restarted: a new session, versions from 1 again
+   forger.send(share_batch(3, 8, 0.10f, 0, 0, 1, cell, 2));
+   sb.receive(*b, frame);
+   check(sb.stale() == stale + 1 && b->evidence(0.5, 0.5) == 2,
+         "share: a restarted robot's deltas are applied");
+
+   delete a;
+   delete b;
+}
+
+int main(int argc, char ** argv) {
+   if( argc > 1 ) {
+      fprintf(stderr, "usage: %s\n", argv[0]);
+      return 1;
+   }
+   check_parallel_raytrace();
+   check_stream_runs();
+   check_share_batches();
+   if( failures ) {
+      printf("%d checks failed\n", failures);
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,84 @@
+/* map_pyramid.cpp
+ *
+ * Multi-resolution "any occupied" pyramid over the obstacle map.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <path_planner/map_pyramid.h>
+#include <path_planner/mem_account.h>
+
+MapPyramid::MapPyramid(int size, int levels) : size_(size), levels_(levels) {
+   level_ = new uint8_t*[levels_ + 1];
+   level_[0] = 0;
+   for( int l=1; l<=levels_; l++ ) {
+      int n = level_size(l);
+      level_[l] = (uint8_t*)calloc(n * n, sizeof(uint8_t));
+      mem_allocated(MEM_PYRAMID, n * n);
+   }
+}
+
+MapPyramid::~MapPyramid() {
+   for( int l=1; l<=levels_; l++ ) {
+      free(level_[l]);
+      mem_freed(MEM_PYRAMID, level_size(l) * level_size(l));
+   }
+   delete [] level_;
+}
+
+bool MapPyramid::clip(int & i0, int & j0, int & i1, int & j1) const {
+   i0 = std::max(i0, 0);
+   j0 = std::max(j0, 0);
+   i1 = std::min(i1, size_ - 1);
+   j1 = std::min(j1, size_ - 1);
+   return i0 <= i1 && j0 <= j1;
+}
+
+void MapPyramid::pool(int i0, int j0, int i1, int j1) {
+   // higher levels pool 2x2 blocks from the level below
+   for( int l=2; l<=levels_; l++ ) {
+      int n = level_size(l);
+      int m = level_size(l-1);
+      const uint8_t * src = level_[l-1];
+      uint8_t * dst = level_[l];
+      for( int bi = i0 >> l; bi <= i1 >> l; bi++ ) {
+         int ci = bi << 1;
+         for( int bj = j0 >> l; bj <= j1 >> l; bj++ ) {
+            int cj = bj << 1;
+            uint8_t any = src[ci*m + cj];
+            if( cj + 1 < m ) any |= src[ci*m + cj + 1];
+            if( ci + 1 < m ) {
+               any |= src[(ci+1)*m + cj];
+               if( cj + 1 < m ) any |= src[(ci+1)*m + cj + 1];
+            }
+            dst[bi*n + bj] = any;
+         }
+      }
+   }
+}
+
+fixed_t MapPyramid::free_margin(fixed_t u, fixed_t v) const {
+   int i = fixed_cell(u);
+   int j = fixed_cell(v);
+   if( i < 0 || i >= size_ || j < 0 || j >= size_ ) return 0;
+
+   // start at the coarsest level; in open terrain that's usually a hit
+   for( int l=levels_; l>0; l-- ) {
+      int bi = i >> l;
+      int bj = j >> l;
+      if( level_[l][bi*level_size(l) + bj] == 0 ) {
+         fixed_t lo_u = ((bi << l) << FIXED_SHIFT) - FIXED_HALF;
+         fixed_t lo_v = ((bj << l) << FIXED_SHIFT) - FIXED_HALF;
+         fixed_t s = (1 << l) << FIXED_SHIFT;
+         fixed_t margin = std::min(std::min(u - lo_u, lo_u + s - u),
+                                   std::min(v - lo_v, lo_v + s - v));
+         return std::max(margin, 0);
+      }
+   }
+   return 0;
+}
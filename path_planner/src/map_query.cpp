@@ -0,0 +1,66 @@
+/* map_query.cpp
+ *
+ * Batched point, ray and arc queries against the obstacle map.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <path_planner/map_query.h>
+
+// map cells per side of the tiles queries are grouped by; the same as the
+//  map's storage blocks
+#define QUERY_TILE 64
+
+// spread the low 16 bits of x out to the even bits
+static uint32_t spread(uint32_t x) {
+   x &= 0xffff;
+   x = (x | (x << 8)) & 0x00ff00ff;
+   x = (x | (x << 4)) & 0x0f0f0f0f;
+   x = (x | (x << 2)) & 0x33333333;
+   x = (x | (x << 1)) & 0x55555555;
+   return x;
+}
+
+void answer_queries(ObstacleMap & map, const std::vector<map_query> & q,
+      std::vector<map_answer> & a) {
+   a.resize(q.size());
+
+   // Z-order of the tile each query starts in, so consecutive queries are
+   //  in the same or neighbouring tiles
+   const double tile = QUERY_TILE * map.resolution();
+   std::vector<std::pair<uint32_t, size_t> > order(q.size());
+   for( size_t k=0; k<q.size(); k++ ) {
+      uint32_t ti = (int)floor(q[k].x / tile) + 0x8000;
+      uint32_t tj = (int)floor(q[k].y / tile) + 0x8000;
+      order[k] = std::make_pair(spread(ti) | (spread(tj) << 1), k);
+   }
+   std::sort(order.begin(), order.end());
+
+   for( size_t n=0; n<order.size(); n++ ) {
+      const map_query & query = q[order[n].second];
+      map_answer & answer = a[order[n].second];
+      answer.cost = 0;
+      answer.range = 0.0;
+      switch( query.type ) {
+         case map_query::POINT:
+            answer.cost = map.get(query.x, query.y);
+            answer.clear = answer.cost == 0;
+            break;
+         case map_query::RAY:
+            answer.range = map.raycast(query.x, query.y, query.theta,
+                  query.l);
+            answer.clear = answer.range >= query.l;
+            break;
+         case map_query::ARC:
+            answer.clear = map.test_arc(query.x, query.y, query.theta,
+                  query.r, query.l);
+            break;
+      }
+   }
+}
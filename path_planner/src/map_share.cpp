@@ -0,0 +1,253 @@
+/* map_share.cpp
+ *
+ * Obstacle evidence shared between robots as tile deltas.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <path_planner/byte_io.h>
+#include <path_planner/map_share.h>
+
+// bytes in a batch before its deltas, in a delta before its cells, and
+//  per cell
+#define BATCH_HEADER 14
+#define DELTA_HEADER 14
+#define CELL_BYTES 3
+
+// floor(a / MAP_TILE), for negative a too
+static int32_t tile_of(int32_t a) {
+   return a >= 0 ? a / MAP_TILE : -((-a + MAP_TILE - 1) / MAP_TILE);
+}
+
+// a session id, different every time; falls back on the time and pid
+//  where there's no /dev/urandom
+static uint32_t new_session() {
+   uint32_t s = 0;
+   FILE * f = fopen("/dev/urandom", "rb");
+   if( f ) {
+      if( fread(&s, sizeof(s), 1, f) != 1 ) s = 0;
+      fclose(f);
+   }
+   if( s == 0 ) {
+      struct timespec t;
+      clock_gettime(CLOCK_REALTIME, &t);
+      s = t.tv_sec ^ t.tv_nsec ^ ((uint32_t)getpid() << 16);
+   }
+   return s;
+}
+
+MapShare::MapShare(uint32_t robot, MapShareTransport & transport) :
+   robot_(robot), session_(new_session()), transport_(transport), map_(0),
+   stamp_(0), stale_(0), rejected_(0) {
+}
+
+void MapShare::find_changes(ObstacleMap & map, const share_frame & frame) {
+   const bool full = &map != map_;
+   const double res = map.resolution();
+   const int size = map.size();
+   const int tiles = (size + MAP_TILE - 1) / MAP_TILE;
+   const double c = cos(frame.theta);
+   const double s = sin(frame.theta);
+
+   // tiles are found through the map's change stamps, which follow costs;
+   //  evidence rising in a cell that's already an obstacle goes with the
+   //  next change to its tile
+   for( int ti=0; ti<tiles; ti++ ) {
+      for( int tj=0; tj<tiles; tj++ ) {
+         const uint32_t t = map.tile_stamp(ti, tj);
+         if( t == 0 || (!full && t <= stamp_) ) continue;
+
+         // the shared tiles under the map tile's corners
+         const double x0 = (ti * MAP_TILE - size/2 - 0.5) * res;
+         const double y0 = (tj * MAP_TILE - size/2 - 0.5) * res;
+         const double w = MAP_TILE * res;
+         double u0 = HUGE_VAL;
+         double v0 = HUGE_VAL;
+         double u1 = -HUGE_VAL;
+         double v1 = -HUGE_VAL;
+         for( int k=0; k<4; k++ ) {
+            const double dx = x0 + (k & 1) * w - frame.x;
+            const double dy = y0 + (k >> 1) * w - frame.y;
+            const double u = c*dx + s*dy;
+            const double v = -s*dx + c*dy;
+            u0 = std::min(u0, u);
+            v0 = std::min(v0, v);
+            u1 = std::max(u1, u);
+            v1 = std::max(v1, v);
+         }
+         const int32_t si0 = tile_of((int32_t)floor(u0 / res + 0.5));
+         const int32_t sj0 = tile_of((int32_t)floor(v0 / res + 0.5));
+         const int32_t si1 = tile_of((int32_t)floor(u1 / res + 0.5));
+         const int32_t sj1 = tile_of((int32_t)floor(v1 / res + 0.5));
+         for( int32_t si=si0; si<=si1; si++ ) {
+            for( int32_t sj=sj0; sj<=sj1; sj++ ) {
+               tile_key key(si, sj);
+               if( queued_.insert(key).second ) queue_.push_back(key);
+            }
+         }
+      }
+   }
+   map_ = &map;
+   stamp_ = map.stamp();
+}
+
+size_t MapShare::send(ObstacleMap & map, const share_frame & frame,
+      size_t max_bytes) {
+   find_changes(map, frame);
+
+   const double res = map.resolution();
+   const double c = cos(frame.theta);
+   const double s = sin(frame.theta);
+
+   batch_.clear();
+   put_u32(batch_, robot_);
+   put_u32(batch_, session_);
+   put_f32(batch_, res);
+   put_u16(batch_, 0);
+
+   int n = 0;
+   while( !queue_.empty() && n < 0xffff ) {
+      const tile_key key = queue_.front();
+      shadow & sh = shadows_[key];
+
+      // compare the tile with what was last sent. falling evidence is just
+      //  decay, which the others apply themselves, unless it's gone
+      changes_.clear();
+      for( int di=0; di<MAP_TILE; di++ ) {
+         const double u = (key.first * MAP_TILE + di) * res;
+         for( int dj=0; dj<MAP_TILE; dj++ ) {
+            const double v = (key.second * MAP_TILE + dj) * res;
+            const map_type e = map.evidence(c*u - s*v + frame.x,
+                  s*u + c*v + frame.y);
+            const int k = di * MAP_TILE + dj;
+            if( e > sh.cells[k] || (e == 0 && sh.cells[k] != 0) ) {
+               changes_.push_back(std::make_pair(k, e));
+            } else {
+               sh.cells[k] = e;
+            }
+         }
+      }
+      if( changes_.empty() ) {
+         queued_.erase(key);
+         queue_.pop_front();
+         continue;
+      }
+
+      // as many of the changes as fit; the tile stays at the front of the
+      //  queue for the rest
+      if( batch_.size() + DELTA_HEADER + CELL_BYTES > max_bytes ) break;
+      const size_t m = std::min(changes_.size(), std::min((size_t)0xffff,
+               (max_bytes - batch_.size() - DELTA_HEADER) / CELL_BYTES));
+      put_u32(batch_, key.first);
+      put_u32(batch_, key.second);
+      put_u32(batch_, ++sh.version);
+      put_u16(batch_, m);
+      for( size_t k=0; k<m; k++ ) {
+         put_u16(batch_, changes_[k].first);
+         batch_.push_back(changes_[k].second);
+         sh.cells[changes_[k].first] = changes_[k].second;
+      }
+      ++n;
+      if( m < changes_.size() ) break;
+      queued_.erase(key);
+      queue_.pop_front();
+   }
+   if( n == 0 ) return 0;
+
+   batch_[BATCH_HEADER - 2] = n;
+   batch_[BATCH_HEADER - 1] = n >> 8;
+   transport_.send(batch_);
+   return batch_.size();
+}
+
+int MapShare::receive(ObstacleMap & map, const share_frame & frame) {
+   const double res = map.resolution();
+   const double c = cos(frame.theta);
+   const double s = sin(frame.theta);
+
+   int applied = 0;
+   x_.clear();
+   y_.clear();
+   v_.clear();
+   while( transport_.receive(batch_) ) {
+      if( batch_.empty() ) {
+         ++rejected_;
+         continue;
+      }
+      byte_reader in(&batch_[0], batch_.size());
+      const uint32_t robot = in.u(4);
+      const uint32_t session = in.u(4);
+      const float r = in.f32();
+      const int n = in.u(2);
+      if( in.ok() && robot == robot_ ) continue;
+      if( !in.ok() || fabs(r - res) > 1e-6 ) {
+         ++rejected_;
+         continue;
+      }
+
+      // check the whole batch before applying any of it
+      const uint8_t * deltas = in.here();
+      for( int k=0; k<n && in.ok(); k++ ) {
+         in.skip(12);
+         in.skip(in.u(2) * CELL_BYTES);
+      }
+      if( !in.ok() ) {
+         ++rejected_;
+         continue;
+      }
+
+      // the robot restarted, and its versions with it
+      std::map<uint32_t, uint32_t>::iterator se = sessions_.find(robot);
+      if( se == sessions_.end() || se->second != session ) {
+         applied_.erase(applied_.lower_bound(std::make_pair(robot,
+                     tile_key(INT32_MIN, INT32_MIN))),
+               applied_.upper_bound(std::make_pair(robot,
+                     tile_key(INT32_MAX, INT32_MAX))));
+         sessions_[robot] = session;
+      }
+
+      byte_reader d(deltas, &batch_[0] + batch_.size() - deltas);
+      for( int k=0; k<n; k++ ) {
+         const int32_t ti = d.u(4);
+         const int32_t tj = d.u(4);
+         const tile_key key(ti, tj);
+         const uint32_t version = d.u(4);
+         const int m = d.u(2);
+
+         const std::pair<uint32_t, tile_key> from(robot, key);
+         std::map<std::pair<uint32_t, tile_key>, uint32_t>::iterator a =
+            applied_.find(from);
+         if( a != applied_.end() && version <= a->second ) {
+            ++stale_;
+            d.skip(m * CELL_BYTES);
+            continue;
+         }
+         applied_[from] = version;
+         ++applied;
+
+         shadow & sh = shadows_[key];
+         for( int q=0; q<m; q++ ) {
+            const int index = d.u(2);
+            const map_type v = std::min(d.u(1), 4u);
+            if( index >= MAP_TILE * MAP_TILE ) continue;
+            const double u = (key.first * MAP_TILE + index / MAP_TILE) * res;
+            const double w = (key.second * MAP_TILE + index % MAP_TILE) *
+               res;
+            x_.push_back(c*u - s*w + frame.x);
+            y_.push_back(s*u + c*w + frame.y);
+            v_.push_back(v);
+            // so it isn't sent back
+            sh.cells[index] = v;
+         }
+      }
+   }
+   if( !v_.empty() ) map.set(x_, y_, v_);
+   return applied;
+}
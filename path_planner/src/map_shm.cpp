@@ -0,0 +1,277 @@
+/* map_shm.cpp
+ *
+ * The obstacle map in a shared-memory segment: writer and reader.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <path_planner/map_shm.h>
+#include <path_planner/mem_account.h>
+
+// the segment's fields are shared with other processes, so they're read
+//  and written with the compiler's atomics rather than a library type whose
+//  layout is its own business
+static uint32_t load(const uint32_t & v, int order) {
+   return __atomic_load_n(&v, order);
+}
+
+static void store(uint32_t & v, uint32_t x, int order) {
+   __atomic_store_n(&v, x, order);
+}
+
+static size_t tile_cells() {
+   return MAP_TILE * MAP_TILE;
+}
+
+static int tiles_for(int size) {
+   return (size + MAP_TILE - 1) / MAP_TILE;
+}
+
+// offset of the tile table and of the cells; both cache-line aligned
+static size_t table_offset() {
+   return (sizeof(map_shm_header) + 63) & ~(size_t)63;
+}
+
+static size_t cells_offset(int size) {
+   size_t t = tiles_for(size);
+   return (table_offset() + t * t * sizeof(map_shm_tile) + 63) &
+      ~(size_t)63;
+}
+
+size_t map_shm_bytes(int size) {
+   size_t t = tiles_for(size);
+   return cells_offset(size) + t * t * tile_cells() * sizeof(map_type);
+}
+
+// mark an existing segment called name stale, so anyone still reading it
+//  lets go, and remove it
+static void retire(const std::string & name) {
+   int fd = shm_open(name.c_str(), O_RDWR, 0);
+   if( fd >= 0 ) {
+      struct stat st;
+      if( fstat(fd, &st) == 0 &&
+            (size_t)st.st_size >= sizeof(map_shm_header) ) {
+         void * p = mmap(0, sizeof(map_shm_header), PROT_READ | PROT_WRITE,
+               MAP_SHARED, fd, 0);
+         if( p != MAP_FAILED ) {
+            map_shm_header * h = (map_shm_header*)p;
+            if( h->magic == MAP_SHM_MAGIC ) {
+               store(h->stale, 1, __ATOMIC_RELEASE);
+            }
+            munmap(p, sizeof(map_shm_header));
+         }
+      }
+      ::close(fd);
+   }
+   shm_unlink(name.c_str());
+}
+
+MapShmWriter::MapShmWriter(const std::string & name) : name_(name),
+   base_(0), bytes_(0), header_(0), tiles_(0), cells_(0), map_(0),
+   published_(0), next_(0), pass_(0), full_(true) {
+}
+
+MapShmWriter::~MapShmWriter() {
+   destroy();
+}
+
+void MapShmWriter::destroy() {
+   if( base_ ) {
+      store(header_->stale, 1, __ATOMIC_RELEASE);
+      munmap(base_, bytes_);
+      mem_freed(MEM_SHARE, bytes_);
+      shm_unlink(name_.c_str());
+      base_ = 0;
+      header_ = 0;
+   }
+}
+
+bool MapShmWriter::create(int size, double resolution) {
+   destroy();
+   retire(name_);
+
+   int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+   if( fd < 0 ) return false;
+   bytes_ = map_shm_bytes(size);
+   void * p = MAP_FAILED;
+   if( ftruncate(fd, bytes_) == 0 ) {
+      p = mmap(0, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   }
+   ::close(fd);
+   if( p == MAP_FAILED ) {
+      shm_unlink(name_.c_str());
+      return false;
+   }
+
+   mem_allocated(MEM_SHARE, bytes_);
+
+   // a new segment is zero-filled: every seqlock even, every cell free
+   base_ = p;
+   header_ = (map_shm_header*)base_;
+   tiles_ = (map_shm_tile*)((char*)base_ + table_offset());
+   cells_ = (map_type*)((char*)base_ + cells_offset(size));
+   header_->version = MAP_SHM_VERSION;
+   header_->size = size;
+   header_->tile = MAP_TILE;
+   header_->tiles = tiles_for(size);
+   header_->resolution = resolution;
+   // readers check the magic number last
+   store(header_->magic, MAP_SHM_MAGIC, __ATOMIC_RELEASE);
+   return true;
+}
+
+bool MapShmWriter::publish(ObstacleMap & map, const std::string & frame,
+      double stamp, double x, double y, double theta, int max_tiles) {
+   if( &map != map_ || !base_ ) {
+      full_ = true;
+      next_ = 0;
+   }
+   if( !base_ || header_->size != map.size() ||
+         header_->resolution != map.resolution() ) {
+      if( !create(map.size(), map.resolution()) ) return false;
+      full_ = true;
+      next_ = 0;
+   }
+   map_ = &map;
+
+   // read_tile may catch a tile up on decay, and that can spill into
+   //  neighbours already copied. they're stamped after pass_, so the next
+   //  pass picks them up
+   if( next_ == 0 ) pass_ = map.stamp();
+
+   // odd sequence number marks a publish in progress
+   const uint32_t seq = load(header_->seq, __ATOMIC_RELAXED);
+   store(header_->seq, seq + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+
+   const uint32_t epoch = header_->epoch + 1;
+   const int tiles = header_->tiles;
+   int copied = 0;
+   for( ; next_ < tiles * tiles && copied < max_tiles; next_++ ) {
+      const int ti = next_ / tiles;
+      const int tj = next_ % tiles;
+      if( !full_ && map.tile_stamp(ti, tj) <= published_ ) continue;
+
+      map_shm_tile & t = tiles_[next_];
+      const uint32_t s = load(t.seq, __ATOMIC_RELAXED);
+      store(t.seq, s + 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+
+      map.read_tile(ti, tj, cells_ + next_ * tile_cells());
+      store(t.epoch, epoch, __ATOMIC_RELAXED);
+
+      store(t.seq, s + 2, __ATOMIC_RELEASE);
+      ++copied;
+   }
+
+   strncpy(header_->frame, frame.c_str(), sizeof(header_->frame) - 1);
+   header_->stamp = stamp;
+   header_->robot_x = x;
+   header_->robot_y = y;
+   header_->robot_theta = theta;
+   header_->epoch = epoch;
+
+   store(header_->seq, seq + 2, __ATOMIC_RELEASE);
+
+   if( next_ == tiles * tiles ) {
+      next_ = 0;
+      published_ = pass_;
+      full_ = false;
+   }
+   return true;
+}
+
+MapShmReader::MapShmReader() : base_(0), bytes_(0), header_(0), tiles_(0),
+   cells_(0) {
+}
+
+MapShmReader::~MapShmReader() {
+   close();
+}
+
+bool MapShmReader::open(const std::string & name) {
+   close();
+   int fd = shm_open(name.c_str(), O_RDONLY, 0);
+   if( fd < 0 ) return false;
+
+   struct stat st;
+   void * p = MAP_FAILED;
+   if( fstat(fd, &st) == 0 &&
+         (size_t)st.st_size >= sizeof(map_shm_header) ) {
+      p = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   }
+   ::close(fd);
+   if( p == MAP_FAILED ) return false;
+
+   const map_shm_header * h = (const map_shm_header*)p;
+   if( load(h->magic, __ATOMIC_ACQUIRE) != MAP_SHM_MAGIC ||
+         h->version != MAP_SHM_VERSION || h->tile != MAP_TILE ||
+         map_shm_bytes(h->size) > (size_t)st.st_size ) {
+      munmap(p, st.st_size);
+      return false;
+   }
+
+   base_ = p;
+   bytes_ = st.st_size;
+   header_ = h;
+   tiles_ = (const map_shm_tile*)((const char*)base_ + table_offset());
+   cells_ = (const map_type*)((const char*)base_ + cells_offset(h->size));
+   return true;
+}
+
+void MapShmReader::close() {
+   if( base_ ) {
+      munmap(base_, bytes_);
+      base_ = 0;
+      header_ = 0;
+   }
+}
+
+bool MapShmReader::stale() const {
+   return load(header_->stale, __ATOMIC_ACQUIRE);
+}
+
+uint32_t MapShmReader::begin() const {
+   return load(header_->seq, __ATOMIC_ACQUIRE);
+}
+
+bool MapShmReader::end(uint32_t seq) const {
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   return !(seq & 1) && load(header_->seq, __ATOMIC_RELAXED) == seq;
+}
+
+const map_type * MapShmReader::tile(int ti, int tj) const {
+   return cells_ + (ti * header_->tiles + tj) * tile_cells();
+}
+
+uint32_t MapShmReader::tile_begin(int ti, int tj) const {
+   return load(tiles_[ti * header_->tiles + tj].seq, __ATOMIC_ACQUIRE);
+}
+
+bool MapShmReader::tile_end(int ti, int tj, uint32_t seq) const {
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   return !(seq & 1) &&
+      load(tiles_[ti * header_->tiles + tj].seq, __ATOMIC_RELAXED) == seq;
+}
+
+uint32_t MapShmReader::tile_epoch(int ti, int tj) const {
+   return load(tiles_[ti * header_->tiles + tj].epoch, __ATOMIC_RELAXED);
+}
+
+bool MapShmReader::read_tile(int ti, int tj, map_type * out,
+      int tries) const {
+   for( int n=0; n<tries; n++ ) {
+      uint32_t seq = tile_begin(ti, tj);
+      memcpy(out, tile(ti, tj), tile_cells() * sizeof(map_type));
+      if( tile_end(ti, tj, seq) ) return true;
+      sched_yield();
+   }
+   return false;
+}
@@ -0,0 +1,191 @@
+/* map_shm_bridge.cpp
+ *
+ * Publish the path planner's shared-memory map as a nav_msgs/OccupancyGrid,
+ * and as a compressed tile stream for slow links, only while something
+ * subscribes to them; see map_shm.h and map_stream.h.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include <ros/ros.h>
+#include <nav_msgs/OccupancyGrid.h>
+
+#include <path_planner/MapStream.h>
+#include <path_planner/costmap_layer.h>
+#include <path_planner/map_shm.h>
+#include <path_planner/map_stream.h>
+
+MapShmReader reader;
+std::string shm_name = "/path_planner_map";
+ros::Publisher map_pub;
+
+// side of the window around the robot to publish (m); 0 for the whole map
+double window = 0.0;
+// epoch of the last map published; 0 to publish the next one regardless
+uint32_t published = 0;
+
+ros::Publisher stream_pub;
+MapStreamEncoder * encoder = 0;
+// stream bandwidth cap (bytes/s), and the bytes it allows sending now
+double stream_bandwidth = 4000.0;
+double stream_budget = 0.0;
+ros::Time stream_last;
+
+// occupancy of each cost
+int8_t occupancy(map_type cost) {
+   switch( cost ) {
+      case COST_FREE:
+         return 0;
+      case COST_INFLATED:
+         return 50;
+      default:
+         return 100;
+   }
+}
+
+// copy the window of the map into grid. false if the planner published
+//  over it every time we tried
+bool read_window(nav_msgs::OccupancyGrid & grid) {
+   const map_shm_header & h = reader.header();
+   for( int tries=0; tries<4; tries++ ) {
+      const uint32_t seq = reader.begin();
+      if( h.epoch == published ) return false;
+
+      int i0 = 0;
+      int j0 = 0;
+      int w = h.size;
+      if( window > 0 ) {
+         w = std::min((int)ceil(window / h.resolution), (int)h.size);
+         i0 = (int)floor(h.robot_x / h.resolution + 0.5) + h.size/2 - w/2;
+         j0 = (int)floor(h.robot_y / h.resolution + 0.5) + h.size/2 - w/2;
+         i0 = std::max(0, std::min(i0, h.size - w));
+         j0 = std::max(0, std::min(j0, h.size - w));
+      }
+
+      grid.header.stamp = ros::Time(h.stamp);
+      grid.header.frame_id = std::string(h.frame,
+            strnlen(h.frame, sizeof(h.frame)));
+      grid.info.resolution = h.resolution;
+      grid.info.width = w;
+      grid.info.height = w;
+      // the origin is the corner of cell (i0, j0)
+      grid.info.origin.position.x = (i0 - h.size/2 - 0.5) * h.resolution;
+      grid.info.origin.position.y = (j0 - h.size/2 - 0.5) * h.resolution;
+      grid.info.origin.orientation.w = 1.0;
+
+      // rows of the grid are y, which is j
+      grid.data.resize((size_t)w * w);
+      for( int j=j0; j<j0+w; j++ ) {
+         int8_t * row = &grid.data[(size_t)(j - j0) * w];
+         for( int i=i0; i<i0+w; i++ ) {
+            const map_type * t = reader.tile(i / MAP_TILE, j / MAP_TILE);
+            row[i - i0] = occupancy(
+                  t[(i % MAP_TILE) * MAP_TILE + j % MAP_TILE]);
+         }
+      }
+
+      if( reader.end(seq) ) {
+         published = h.epoch;
+         return true;
+      }
+   }
+   ROS_WARN_THROTTLE(10.0, "Map kept changing while it was read");
+   return false;
+}
+
+// open the map, or open it again if the planner replaced it. false if
+//  there is none
+bool open_map() {
+   if( reader.is_open() && reader.stale() ) reader.close();
+   if( !reader.is_open() ) {
+      if( !reader.open(shm_name) ) {
+         ROS_WARN_THROTTLE(10.0, "No map in shared memory at %s",
+               shm_name.c_str());
+         return false;
+      }
+      published = 0;
+      if( encoder ) encoder->keyframe();
+   }
+   return true;
+}
+
+void timerCb(const ros::TimerEvent &) {
+   if( map_pub.getNumSubscribers() == 0 || !open_map() ) return;
+
+   nav_msgs::OccupancyGrid grid;
+   if( read_window(grid) ) map_pub.publish(grid);
+}
+
+// a new subscriber gets the current map, even if it hasn't changed
+void connectCb(const ros::SingleSubscriberPublisher &) {
+   published = 0;
+}
+
+void streamCb(const ros::TimerEvent & e) {
+   // the budget fills at the bandwidth cap, up to a second of it, and
+   //  never less than the largest tile, so any tile can eventually be sent
+   const double burst = std::max(stream_bandwidth, 8192.0);
+   if( !stream_last.isZero() ) {
+      stream_budget += stream_bandwidth * (e.current_real -
+            stream_last).toSec();
+   }
+   stream_budget = std::min(stream_budget, burst);
+   stream_last = e.current_real;
+
+   if( stream_pub.getNumSubscribers() == 0 || !open_map() ) return;
+
+   path_planner::MapStream frame;
+   if( !encoder->encode(reader, e.current_real.toSec(), stream_budget,
+            frame.data) ) {
+      return;
+   }
+   frame.header.stamp = e.current_real;
+   frame.header.frame_id = std::string(reader.header().frame,
+         strnlen(reader.header().frame, sizeof(reader.header().frame)));
+   stream_budget -= frame.data.size();
+   stream_pub.publish(frame);
+}
+
+// a new stream subscriber can't decode anything until a keyframe
+void streamConnectCb(const ros::SingleSubscriberPublisher &) {
+   encoder->keyframe();
+}
+
+int main(int argc, char ** argv) {
+   ros::init(argc, argv, "map_shm_bridge");
+
+   ros::NodeHandle n;
+   ros::NodeHandle pn("~");
+
+   double rate = 1.0;
+   n.getParam("map_shm_name", shm_name);
+   pn.getParam("window", window);
+   pn.getParam("rate", rate);
+
+   map_pub = n.advertise<nav_msgs::OccupancyGrid>("map", 1, connectCb);
+   ros::Timer timer = n.createTimer(ros::Duration(1.0 / rate), timerCb);
+
+   // the compressed stream sends frames at stream_rate, within
+   //  stream_bandwidth bytes/s; 0 disables it
+   double stream_rate = 2.0;
+   double keyframe_interval = 30.0;
+   pn.getParam("stream_rate", stream_rate);
+   pn.getParam("stream_bandwidth", stream_bandwidth);
+   pn.getParam("keyframe_interval", keyframe_interval);
+   ros::Timer stream_timer;
+   if( stream_rate > 0 && stream_bandwidth > 0 ) {
+      encoder = new MapStreamEncoder(keyframe_interval);
+      stream_pub = n.advertise<path_planner::MapStream>("map_stream", 10,
+            streamConnectCb);
+      stream_timer = n.createTimer(ros::Duration(1.0 / stream_rate),
+            streamCb);
+   }
+
+   ros::spin();
+}
@@ -0,0 +1,264 @@
+/* map_stream.cpp
+ *
+ * Compressed map tile stream: run-length coding, encoder and decoder.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <path_planner/byte_io.h>
+#include <path_planner/map_stream.h>
+
+// bytes in a frame before its tiles, and before each tile's runs
+#define FRAME_HEADER 35
+#define TILE_HEADER 6
+
+// longest run a single byte holds; longer ones continue in a varint
+#define SHORT_RUN 63
+
+void map_stream_encode_runs(const map_type * cells, size_t n,
+      std::vector<uint8_t> & out) {
+   size_t k = 0;
+   while( k < n ) {
+      const map_type c = cells[k];
+      size_t len = 1;
+      while( k + len < n && cells[k + len] == c ) len++;
+      k += len;
+
+      if( len <= SHORT_RUN ) {
+         out.push_back((len - 1) << 2 | (c & 3));
+      } else {
+         out.push_back(SHORT_RUN << 2 | (c & 3));
+         size_t extra = len - SHORT_RUN - 1;
+         while( extra >= 0x80 ) {
+            out.push_back((extra & 0x7f) | 0x80);
+            extra >>= 7;
+         }
+         out.push_back(extra);
+      }
+   }
+}
+
+bool map_stream_decode_runs(const uint8_t * data, size_t bytes,
+      map_type * cells, size_t n) {
+   const uint8_t * end = data + bytes;
+   size_t k = 0;
+   while( data < end ) {
+      const map_type c = *data & 3;
+      size_t len = (*data >> 2) + 1;
+      ++data;
+      if( len > SHORT_RUN ) {
+         size_t extra = 0;
+         int shift = 0;
+         do {
+            if( data == end || shift > 28 ) return false;
+            extra |= (size_t)(*data & 0x7f) << shift;
+            shift += 7;
+         } while( *data++ & 0x80 );
+         len = SHORT_RUN + 1 + extra;
+      }
+      if( len > n - k ) return false;
+      memset(cells + k, c, len);
+      k += len;
+   }
+   return k == n;
+}
+
+MapStreamEncoder::MapStreamEncoder(double keyframe_interval) :
+   keyframe_interval_(keyframe_interval), last_keyframe_(0.0),
+   keyframe_due_(true), keyframe_(false), begun_(false), todo_count_(0),
+   seq_(0), size_(0), resolution_(0.0), cells_(MAP_TILE * MAP_TILE) {
+}
+
+bool MapStreamEncoder::encode(const MapShmReader & map, double now,
+      size_t max_bytes, std::vector<uint8_t> & frame) {
+   const map_shm_header & h = map.header();
+   const int tiles = h.tiles;
+   if( h.size != size_ || h.resolution != resolution_ ) {
+      size_ = h.size;
+      resolution_ = h.resolution;
+      sent_.assign(tiles * tiles, 0);
+      sent_seq_.assign(tiles * tiles, seq_);
+      todo_.assign(tiles * tiles, false);
+      todo_count_ = 0;
+      keyframe_ = false;
+      keyframe_due_ = true;
+   }
+   if( !keyframe_ && (keyframe_due_ ||
+            now - last_keyframe_ >= keyframe_interval_) ) {
+      todo_.assign(tiles * tiles, true);
+      todo_count_ = tiles * tiles;
+      keyframe_ = true;
+      keyframe_due_ = false;
+      begun_ = false;
+      last_keyframe_ = now;
+   }
+   if( max_bytes < FRAME_HEADER ) return false;
+
+   // the robot's pose, consistently if the planner lets us
+   double stamp = 0.0;
+   double x = 0.0;
+   double y = 0.0;
+   double theta = 0.0;
+   for( int tries=0; tries<4; tries++ ) {
+      uint32_t seq = map.begin();
+      stamp = h.stamp;
+      x = h.robot_x;
+      y = h.robot_y;
+      theta = h.robot_theta;
+      if( map.end(seq) ) break;
+   }
+
+   // tiles to send, nearest the robot first. a tile gains a tile of
+   //  nearness for every frame it has waited since it was last sent, so
+   //  when the changes outrun the budget the far ones, and keyframes, still
+   //  get through
+   const double ri = x / resolution_ / MAP_TILE + size_/2.0 / MAP_TILE;
+   const double rj = y / resolution_ / MAP_TILE + size_/2.0 / MAP_TILE;
+   order_.clear();
+   for( int ti=0; ti<tiles; ti++ ) {
+      for( int tj=0; tj<tiles; tj++ ) {
+         const int t = ti * tiles + tj;
+         if( !todo_[t] && map.tile_epoch(ti, tj) == sent_[t] ) continue;
+         const double d = hypot(ti + 0.5 - ri, tj + 0.5 - rj);
+         order_.push_back(std::make_pair((int64_t)d -
+                  (int64_t)(seq_ - sent_seq_[t]), t));
+      }
+   }
+   if( order_.empty() ) return false;
+   std::sort(order_.begin(), order_.end());
+
+   frame.clear();
+   put_u32(frame, seq_ + 1);
+   frame.push_back(0);
+   put_u32(frame, size_);
+   put_f32(frame, resolution_);
+   put_f64(frame, stamp);
+   put_f32(frame, x);
+   put_f32(frame, y);
+   put_f32(frame, theta);
+   put_u16(frame, 0);
+
+   int n = 0;
+   for( size_t k=0; k<order_.size() && n < 0xffff; k++ ) {
+      const int t = order_[k].second;
+      const int ti = t / tiles;
+      const int tj = t % tiles;
+      // the epoch before the copy, so a change during it is sent again
+      const uint32_t epoch = map.tile_epoch(ti, tj);
+      if( !map.read_tile(ti, tj, &cells_[0]) ) continue;
+
+      runs_.clear();
+      map_stream_encode_runs(&cells_[0], cells_.size(), runs_);
+      if( frame.size() + TILE_HEADER + runs_.size() > max_bytes ) break;
+
+      put_u16(frame, ti);
+      put_u16(frame, tj);
+      put_u16(frame, runs_.size());
+      frame.insert(frame.end(), runs_.begin(), runs_.end());
+      sent_[t] = epoch;
+      sent_seq_[t] = seq_;
+      if( todo_[t] ) {
+         todo_[t] = false;
+         --todo_count_;
+      }
+      ++n;
+   }
+   if( n == 0 ) {
+      frame.clear();
+      return false;
+   }
+
+   uint8_t flags = 0;
+   if( keyframe_ && !begun_ ) {
+      flags |= MAP_STREAM_KEYFRAME_BEGIN;
+      begun_ = true;
+   }
+   if( keyframe_ && todo_count_ == 0 ) {
+      flags |= MAP_STREAM_KEYFRAME_END;
+      keyframe_ = false;
+   }
+   frame[4] = flags;
+   frame[FRAME_HEADER - 2] = n;
+   frame[FRAME_HEADER - 1] = n >> 8;
+   ++seq_;
+   return true;
+}
+
+MapStreamDecoder::MapStreamDecoder() : size_(0), resolution_(0.0),
+   stamp_(0.0), robot_x_(0.0), robot_y_(0.0), robot_theta_(0.0),
+   started_(false), seq_(0), lost_(0), keyframe_intact_(false),
+   synced_(false), tile_(MAP_TILE * MAP_TILE) {
+}
+
+bool MapStreamDecoder::decode(const uint8_t * frame, size_t bytes) {
+   byte_reader in(frame, bytes);
+   const uint32_t seq = in.u(4);
+   const uint8_t flags = in.u(1);
+   const uint32_t size = in.u(4);
+   const float resolution = in.f32();
+   const double stamp = in.f64();
+   const float x = in.f32();
+   const float y = in.f32();
+   const float theta = in.f32();
+   const int n = in.u(2);
+   if( !in.ok() || size == 0 || size > 0xffff * MAP_TILE ) return false;
+
+   // check every tile before changing anything
+   const uint8_t * tiles = in.here();
+   for( int k=0; k<n; k++ ) {
+      const uint32_t ti = in.u(2);
+      const uint32_t tj = in.u(2);
+      const uint32_t len = in.u(2);
+      const uint8_t * runs = in.here();
+      if( !in.skip(len) || ti * MAP_TILE >= size || tj * MAP_TILE >= size ||
+            !map_stream_decode_runs(runs, len, &tile_[0], tile_.size()) ) {
+         return false;
+      }
+   }
+
+   if( (int)size != size_ || resolution != (float)resolution_ ) {
+      size_ = size;
+      resolution_ = resolution;
+      cells_.assign((size_t)size * size, 0);
+      synced_ = false;
+      keyframe_intact_ = false;
+   }
+   if( started_ && seq != seq_ + 1 ) {
+      lost_ += (uint32_t)(seq - seq_ - 1);
+      synced_ = false;
+      keyframe_intact_ = false;
+   }
+   started_ = true;
+   seq_ = seq;
+   stamp_ = stamp;
+   robot_x_ = x;
+   robot_y_ = y;
+   robot_theta_ = theta;
+
+   byte_reader again(tiles, frame + bytes - tiles);
+   for( int k=0; k<n; k++ ) {
+      const int ti = again.u(2);
+      const int tj = again.u(2);
+      const uint32_t len = again.u(2);
+      map_stream_decode_runs(again.here(), len, &tile_[0], tile_.size());
+      again.skip(len);
+
+      const int di1 = std::min(MAP_TILE, size_ - ti * MAP_TILE);
+      const int dj1 = std::min(MAP_TILE, size_ - tj * MAP_TILE);
+      for( int di=0; di<di1; di++ ) {
+         memcpy(&cells_[(size_t)(ti * MAP_TILE + di) * size_ +
+               tj * MAP_TILE], &tile_[di * MAP_TILE], dj1);
+      }
+   }
+
+   if( flags & MAP_STREAM_KEYFRAME_BEGIN ) keyframe_intact_ = true;
+   if( (flags & MAP_STREAM_KEYFRAME_END) && keyframe_intact_ ) {
+      synced_ = true;
+   }
+   return true;
+}
@@ -0,0 +1,44 @@
+/* obstacle_map.cpp
+ *
+ * Runtime selection of the obstacle map geometry.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <path_planner/grid_map.h>
+#include <path_planner/obstacle_map.h>
+
+// every supported geometry, as (cells, mm per cell). the order is that of
+//  the map_geometry enum in cfg/PathPlanner.cfg
+#define GEOMETRIES(X) \
+   X(5000, 100)   /* 500m at 10cm */ \
+   X(10000, 50)   /* 500m at 5cm */ \
+   X(2500, 200)   /* 500m at 20cm */ \
+   X(2500, 100)   /* 250m at 10cm */ \
+   X(5000, 200)   /* 1km at 20cm */
+
+// every supported geometry gets its own instantiation of GridMap, with the
+//  size and resolution folded into the inner loops as constants
+#define GEOMETRY(size, res_mm) \
+   if( size == s && res_mm == r ) \
+      return new GridMap<grid_geometry<size, res_mm> >(pages, numa_node, \
+            local_size);
+
+ObstacleMap * ObstacleMap::create(int s, double res, map_pages pages,
+      int numa_node, int local_size) {
+   int r = (int)(res * 1000.0 + 0.5);
+   GEOMETRIES(GEOMETRY)
+   return 0;
+}
+
+#define GEOMETRY_ENTRY(size, res_mm) { size, res_mm },
+
+bool ObstacleMap::geometry(int k, int & size, double & res) {
+   static const int geometries[][2] = { GEOMETRIES(GEOMETRY_ENTRY) };
+   if( k < 0 || k >= (int)(sizeof(geometries) / sizeof(geometries[0])) ) {
+      return false;
+   }
+   size = geometries[k][0];
+   res = geometries[k][1] / 1000.0;
+   return true;
+}
@@ -0,0 +1,136 @@
+/* odom_history.cpp
+ *
+ * Fixed-capacity, lock-free history of timestamped odometry poses.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <math.h>
+
+#include <path_planner/odom_history.h>
+
+odom_pose interpolate(const odom_pose & a, const odom_pose & b, double f) {
+   odom_pose ret;
+   double dtheta = b.theta - a.theta;
+   while( dtheta > M_PI )  dtheta -= 2.0 * M_PI;
+   while( dtheta < -M_PI ) dtheta += 2.0 * M_PI;
+
+   ret.stamp = a.stamp + f * (b.stamp - a.stamp);
+   ret.x = a.x + f * (b.x - a.x);
+   ret.y = a.y + f * (b.y - a.y);
+   ret.theta = a.theta + f * dtheta;
+   return ret;
+}
+
+OdomHistory::OdomHistory(size_t capacity, double max_extrapolation) :
+   max_extrapolation_(max_extrapolation), head_(0) {
+   size_t n = 2;
+   while( n < capacity ) n <<= 1;
+   mask_ = n - 1;
+   slots_ = new slot[n];
+   for( size_t i=0; i<n; i++ ) {
+      slots_[i].seq.store(0, boost::memory_order_relaxed);
+      slots_[i].index = 0;
+   }
+}
+
+OdomHistory::~OdomHistory() {
+   delete [] slots_;
+}
+
+void OdomHistory::push(const odom_pose & pose) {
+   uint64_t h = head_.load(boost::memory_order_relaxed);
+   slot & s = slots_[h & mask_];
+
+   // odd sequence number marks the slot as being written
+   uint32_t seq = s.seq.load(boost::memory_order_relaxed);
+   s.seq.store(seq + 1, boost::memory_order_relaxed);
+   boost::atomic_thread_fence(boost::memory_order_release);
+
+   s.index = h;
+   s.pose = pose;
+
+   s.seq.store(seq + 2, boost::memory_order_release);
+   head_.store(h + 1, boost::memory_order_release);
+}
+
+bool OdomHistory::read(uint64_t i, odom_pose & out) const {
+   const slot & s = slots_[i & mask_];
+   for( int tries=0; tries<4; tries++ ) {
+      uint32_t seq = s.seq.load(boost::memory_order_acquire);
+      if( seq & 1 ) continue;
+
+      uint64_t index = s.index;
+      out = s.pose;
+
+      boost::atomic_thread_fence(boost::memory_order_acquire);
+      if( s.seq.load(boost::memory_order_relaxed) == seq ) {
+         return index == i;
+      }
+   }
+   return false;
+}
+
+bool OdomHistory::latest(odom_pose & out) const {
+   uint64_t h = head_.load(boost::memory_order_acquire);
+   if( h == 0 ) return false;
+   return read(h - 1, out);
+}
+
+bool OdomHistory::lookup(double t, odom_pose & out) const {
+   uint64_t h = head_.load(boost::memory_order_acquire);
+   if( h == 0 ) return false;
+
+   uint64_t newest = h - 1;
+   // leave one slot of slack for a writer that's lapping us
+   uint64_t oldest = h > mask_ ? h - mask_ : 0;
+
+   odom_pose a, b;
+   if( !read(newest, b) ) return false;
+   if( newest == oldest ) {
+      out = b;
+      return t >= b.stamp;
+   }
+
+   if( t >= b.stamp ) {
+      // newer than anything we have; extrapolate from the last two samples
+      if( !read(newest - 1, a) ) return false;
+      double dt = b.stamp - a.stamp;
+      double ext = t - b.stamp;
+      if( ext > max_extrapolation_ ) ext = max_extrapolation_;
+      out = dt > 0 ? interpolate(a, b, 1.0 + ext / dt) : b;
+      return true;
+   }
+
+   if( !read(oldest, a) ) return false;
+   if( t < a.stamp ) return false;
+
+   // odometry arrives at a nearly fixed rate, so guess the slot directly
+   //  from the average sample period and then walk the last step or two
+   double period = (b.stamp - a.stamp) / (newest - oldest);
+   uint64_t k = oldest;
+   if( period > 0 ) {
+      double back = ceil((b.stamp - t) / period);
+      if( back < newest - oldest ) {
+         k = newest - (uint64_t)back;
+      }
+   }
+   if( k >= newest ) k = newest - 1;
+
+   if( !read(k, a) || !read(k + 1, b) ) return false;
+   while( a.stamp > t && k > oldest ) {
+      --k;
+      b = a;
+      if( !read(k, a) ) return false;
+   }
+   while( b.stamp <= t && k + 1 < newest ) {
+      ++k;
+      a = b;
+      if( !read(k + 1, b) ) return false;
+   }
+
+   double dt = b.stamp - a.stamp;
+   out = dt > 0 ? interpolate(a, b, (t - a.stamp) / dt) : b;
+   out.stamp = t;
+   return true;
+}
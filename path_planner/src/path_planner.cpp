@@ -25,32 +25,60 @@
 
 #include <math.h>
 #include <assert.h>
+#include <semaphore.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <time.h>
+#include <unistd.h>
 
+#include <deque>
 #include <set>
 #include <list>
 #include <map>
 #include <vector>
 
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <tf/tf.h>
+#include <tf2_ros/transform_broadcaster.h>
 #include <tf2_ros/transform_listener.h>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
 
 #include <nav_msgs/Odometry.h>
-#include <nav_msgs/OccupancyGrid.h>
 #include <nav_msgs/Path.h>
 #include <sensor_msgs/LaserScan.h>
 #include <sensor_msgs/NavSatFix.h>
+#include <sensor_msgs/PointCloud2.h>
 #include <std_msgs/Bool.h>
 #include <std_msgs/Float32.h>
+#include <std_msgs/UInt32.h>
 #include <visualization_msgs/Marker.h>
 #include <geometry_msgs/PointStamped.h>
 
 #include <dynamic_reconfigure/server.h>
+#include <mem_account/mem_report.h>
 #include <path_planner/PathPlannerConfig.h>
+#include <path_planner/MapDeltas.h>
+#include <path_planner/QueryMap.h>
+
+#include <path_planner/cloud_bins.h>
+#include <path_planner/cone_servo.h>
+#include <path_planner/keepout.h>
+#include <path_planner/latency_stats.h>
+#include <path_planner/map_query.h>
+#include <path_planner/map_share.h>
+#include <path_planner/map_shm.h>
+#include <path_planner/mem_account.h>
+#include <path_planner/obstacle_map.h>
+#include <path_planner/odom_history.h>
+#include <path_planner/realtime.h>
+#include <path_planner/scan_deskew.h>
+#include <path_planner/scan_matcher.h>
+#include <path_planner/spsc_ring.h>
+#include <path_planner/worker_pool.h>
 
 using namespace std;
 
@@ -65,13 +93,6 @@ double goal_err = 0.3;
 double cone_dist = 6.0;
 
 
-// map resolution, in meters per pixel
-// TODO: convert to parameter
-#define MAP_RES 0.10
-// map size, in cells
-// TODO: convert to parameter
-#define MAP_SIZE 5000
-
 // speed for path traversal (m/s)
 double max_speed = 1.5;
 double min_speed = 0.1;
@@ -88,6 +109,10 @@ double stuck_timeout = 2.0;
 // cone-tracking values
 double cone_timeout = 1.0;
 double cone_speed = 0.4;
+double cone_gain = 1.4;
+double cone_gate = 0.3;
+// how old a camera frame is when its bearing arrives (s)
+double cone_latency = 0.1;
 
 // enable/disable for cone mode
 bool track_cones = false;
@@ -95,7 +120,11 @@ bool track_cones = false;
 // planner active
 bool active = false;
 
+// the odometry frame, from the first pose. set once, by positionCallback,
+//  which may be on the control thread; any thread can read it once
+//  have_position_frame says it's there
 std::string position_frame;
+boost::atomic<bool> have_position_frame(false);
 
 // types, to make life easier
 struct loc {
@@ -115,71 +144,56 @@ struct path {
    double radius;
 };
 
-// the local obstacle map
-// fixed dimensions: 100m by 100m, centered about the associated center point
+// the obstacle map
+//  fixed dimensions, centered about the odometry origin. the geometry is
+//  picked at startup from the map_size and map_resolution parameters
 // FIXME: replace this with calls to the global_map and SLAM
-typedef int8_t map_type;
-map_type * map_data;
-
-// get the value of the local obstacle map at (x, y)
-//  return 0 for any point not within the obstacle map
-inline map_type map_get(double x, double y) {
-   int i = round(x/MAP_RES) + MAP_SIZE/2;
-   int j = round(y/MAP_RES) + MAP_SIZE/2;
-   if( i >= 0 && i < MAP_SIZE && j >= 0 && j < MAP_SIZE ) {
-      return map_data[(i * MAP_SIZE) + j];
-   } else {
-      return 0;
-   }
+ObstacleMap * obstacle_map;
+
+// run odometry and planning on a control thread of their own, under
+//  SCHED_FIFO, with memory locked (see realtime.h). that thread doesn't
+//  log, publish or look up transforms; see controlOutThread and
+//  transform_goal
+bool realtime = false;
+
+// held by anything that reads or writes what the control thread uses: the
+//  map and map_correction, the goal, the planner and cone state, and the
+//  parameters. priority inheritance keeps a mapping pass that holds it
+//  from being preempted while the control thread waits. held only around
+//  the map updates themselves, never around the raytracing into the
+//  local map or anything that blocks
+PiMutex planner_mutex;
+
+// how late odometry reaches the control thread, how long it waits for
+//  planner_mutex, and how long from receiving odometry to sending the
+//  command, or to handing it to controlOutThread when real-time. recorded with or without the real-time profile, so the two
+//  can be compared; see latencyCb
+LatencyStats odom_latency;
+LatencyStats control_wait;
+LatencyStats control_cycle;
+
+// CLOCK_MONOTONIC, in seconds
+double monotonic_now() {
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec + t.tv_nsec * 1e-9;
 }
 
-// get the value of the local obstacle map at (x, y)
-//  return 0 for any point not within the obstacle map
-inline void map_set(double x, double y, map_type v) {
-   int i = round(x/MAP_RES) + MAP_SIZE/2;
-   int j = round(y/MAP_RES) + MAP_SIZE/2;
-   if( i >= 0 && i < MAP_SIZE && j >= 0 && j < MAP_SIZE ) {
-      map_data[(i * MAP_SIZE) + j] = v;
-   }
-}
+// obstacle decay period (s)
+double obstacle_decay = 10.0;
 
-// test if we have a collision at a particular point
-bool test_collision(loc here) {
-   return map_get(here.x, here.y) != 0;
-}
+// drift correction from odometry to the map, from scan matching. the
+//  planner works in the odometry frame; the map is in the corrected frame
+correction map_correction;
 
 // test an arc start at start with radius r for length l
 bool test_arc(loc start, double r, double l) {
-   if( r != 0.0 ) {
-      // normal case; traverse an arc
-      double center_x, center_y, theta;
-      theta = start.pose - M_PI/2;
-      center_x = start.x + r * cos(start.pose + M_PI/2);
-      center_y = start.y + r * sin(start.pose + M_PI/2);
-
-      // traverse along the arc until we hit something
-      for( double dist = 0; dist < l; dist += MAP_RES/2.0 ) {
-         loc h;
-         h.x = r * cos(theta + dist / r) + center_x;
-         h.y = r * sin(theta + dist / r) + center_y;
-         if( test_collision(h) ) {
-            //ROS_WARN("Obstacle at %lf", dist);
-            return false;
-         }
-      }
-   } else {
-      // degenerate case; traverse a line
-      for( double dist = 0; dist < l; dist += MAP_RES/2.0 ) {
-         loc h;
-         h.x = start.x + dist*cos(start.pose);
-         h.y = start.y + dist*sin(start.pose);
-         if( test_collision(h) ) {
-            //ROS_WARN("Obstacle at %lf", dist);
-            return false;
-         }
-      }
-   }
-   return true;
+   odom_pose p;
+   p.x = start.x;
+   p.y = start.y;
+   p.theta = start.pose;
+   p = correct(map_correction, p);
+   return obstacle_map->test_arc(p.x, p.y, p.theta, r, l);
 }
 
 nav_msgs::Path arcToPath(loc start, double r, double l) {
@@ -193,7 +207,7 @@ nav_msgs::Path arcToPath(loc start, double r, double l) {
       center_y = start.y + r * sin(start.pose + M_PI/2);
 
       // traverse along the arc until we hit something
-      for( double dist = 0; dist < l; dist += MAP_RES/2.0 ) {
+      for( double dist = 0; dist < l; dist += obstacle_map->resolution()/2.0 ) {
          double x = r * cos(theta + dist / r) + center_x;
          double y = r * sin(theta + dist / r) + center_y;
          geometry_msgs::PoseStamped pose;
@@ -205,7 +219,7 @@ nav_msgs::Path arcToPath(loc start, double r, double l) {
       }
    } else {
       // degenerate case; traverse a line
-      for( double dist = 0; dist < l; dist += MAP_RES/2.0 ) {
+      for( double dist = 0; dist < l; dist += obstacle_map->resolution()/2.0 ) {
          geometry_msgs::PoseStamped pose;
          pose.header.frame_id = position_frame;
          pose.pose.position.x = start.x + dist*cos(start.pose);
@@ -237,11 +251,276 @@ loc arc_end(loc start, double r, double l) {
    return ret;
 }
 
+// the last arc the planner tested in full and took, in the map frame,
+//  and the map stamp it was known clear at. the robot is usually still on
+//  it, so most of it doesn't need testing again
+struct planned_arc {
+   bool valid;
+   double x;
+   double y;
+   double theta;
+   double r;
+   double l;
+   uint32_t stamp;
+
+   planned_arc() : valid(false), x(0.0), y(0.0), theta(0.0), r(0.0),
+      l(0.0), stamp(0) {}
+};
+
+planned_arc last_arc;
+
+// pose s meters along the arc from p with radius r
+odom_pose along_arc(const odom_pose & p, double r, double s) {
+   odom_pose ret;
+   if( r != 0.0 ) {
+      double cx = p.x - r * sin(p.theta);
+      double cy = p.y + r * cos(p.theta);
+      ret.theta = p.theta + s / r;
+      ret.x = cx + r * sin(ret.theta);
+      ret.y = cy - r * cos(ret.theta);
+   } else {
+      ret.x = p.x + s * cos(p.theta);
+      ret.y = p.y + s * sin(p.theta);
+      ret.theta = p.theta;
+   }
+   return ret;
+}
+
+// how far along last_arc p is, if an arc of radius r and length l from p
+//  stays within half a cell of it; -1 if it doesn't. test_arc only samples
+//  every half cell, so that's as close as it can tell arcs apart anyway
+double along_last_arc(const odom_pose & p, double r, double l) {
+   const double tol = obstacle_map->resolution() / 2.0;
+   const double k = r == 0.0 ? 0.0 : 1.0 / r;
+   const double k_last = last_arc.r == 0.0 ? 0.0 : 1.0 / last_arc.r;
+   if( fabs(k - k_last) * l * l / 2.0 > tol ) return -1.0;
+
+   // distance along, distance off, and heading of the arc at p
+   double s;
+   double off;
+   double heading = last_arc.theta;
+   const double c = cos(last_arc.theta);
+   const double sn = sin(last_arc.theta);
+   if( last_arc.r != 0.0 ) {
+      const double cx = last_arc.x - last_arc.r * sn;
+      const double cy = last_arc.y + last_arc.r * c;
+      double a = remainder(atan2(p.y - cy, p.x - cx) -
+            atan2(last_arc.y - cy, last_arc.x - cx), 2.0 * M_PI);
+      s = a * last_arc.r;
+      off = hypot(p.x - cx, p.y - cy) - fabs(last_arc.r);
+      heading += s / last_arc.r;
+   } else {
+      s = (p.x - last_arc.x) * c + (p.y - last_arc.y) * sn;
+      off = (p.y - last_arc.y) * c - (p.x - last_arc.x) * sn;
+   }
+   const double dh = remainder(p.theta - heading, 2.0 * M_PI);
+   if( s < 0.0 || s > last_arc.l || fabs(off) > tol ||
+         fabs(dh) * l > tol ) {
+      return -1.0;
+   }
+   return s;
+}
+
+// remember an arc from p that was just tested in full and found clear
+void keep_arc(const odom_pose & p, double r, double l) {
+   last_arc.valid = true;
+   last_arc.x = p.x;
+   last_arc.y = p.y;
+   last_arc.theta = p.theta;
+   last_arc.r = r;
+   last_arc.l = l;
+   last_arc.stamp = obstacle_map->stamp();
+}
+
+// test_arc, warm-started from last_arc: if the arc follows on from it,
+//  only the part past its end is tested, and the rest only if any tile
+//  along it changed since it was tested. once we're halfway along
+//  last_arc, the arc is tested in full and kept instead, so the half-cell
+//  slack in following it can't accumulate.
+//
+// this is an approximation: the arc actually asked about may pass up to
+//  half a cell from the one tested, and so through a cell test_arc would
+//  have sampled and last_arc didn't. a start further off than that, or a
+//  different radius, is always tested in full
+bool retest_arc(loc start, double r, double l) {
+   odom_pose p;
+   p.x = start.x;
+   p.y = start.y;
+   p.theta = start.pose;
+   p = correct(map_correction, p);
+
+   if( last_arc.valid ) {
+      const double s = along_last_arc(p, r, l);
+      if( s >= 0.0 && s < last_arc.l / 2.0 ) {
+         const double known = last_arc.l - s;
+         if( !obstacle_map->arc_changed(p.x, p.y, p.theta, r,
+                  min(l, known), last_arc.stamp) ) {
+            if( l <= known ) return true;
+            odom_pose tail = along_arc(p, r, known);
+            return obstacle_map->test_arc(tail.x, tail.y, tail.theta, r,
+                  l - known);
+         }
+      }
+   }
+   if( obstacle_map->test_arc(p.x, p.y, p.theta, r, l) ) {
+      keep_arc(p, r, l);
+      return true;
+   }
+   return false;
+}
+
 #define dist(a, b) hypot(a.x - b.x, a.y - b.y)
 
 ros::Publisher path_pub;
 ros::Publisher done_pub;
 ros::Time done_time;
+// publisher for publishing movement commands
+ros::Publisher cmd_pub;
+
+// when real-time, the control thread neither logs nor publishes: both can
+//  block, allocate, and take locks that normal-priority threads hold. it
+//  hands its messages and commands through a ring to controlOutThread,
+//  which it wakes with a semaphore; sem_post never blocks
+enum control_out_kind {
+   OUT_INFO, OUT_WARN, OUT_ERROR, OUT_CMD, OUT_DONE
+};
+struct control_out {
+   control_out_kind kind;
+   // OUT_INFO, OUT_WARN and OUT_ERROR
+   char text[128];
+   // OUT_CMD
+   double linear;
+   double angular;
+   // OUT_DONE
+   bool done;
+};
+SpscRing<control_out> control_ring(64);
+sem_t control_wake;
+// lost because the ring was full
+boost::atomic<uint32_t> control_dropped(0);
+
+void control_send(const control_out & out) {
+   if( !control_ring.push(out) ) ++control_dropped;
+   sem_post(&control_wake);
+}
+
+void control_print(control_out_kind kind, const char * text) {
+   switch( kind ) {
+      case OUT_WARN:
+         ROS_WARN("%s", text);
+         break;
+      case OUT_ERROR:
+         ROS_ERROR("%s", text);
+         break;
+      default:
+         ROS_INFO("%s", text);
+         break;
+   }
+}
+
+// log from the control path; kind is OUT_INFO, OUT_WARN or OUT_ERROR
+void control_log(control_out_kind kind, const char * format, ...)
+   __attribute__((format(printf, 2, 3)));
+void control_log(control_out_kind kind, const char * format, ...) {
+   control_out out;
+   out.kind = kind;
+   va_list args;
+   va_start(args, format);
+   vsnprintf(out.text, sizeof(out.text), format, args);
+   va_end(args);
+   if( realtime ) {
+      control_send(out);
+   } else {
+      control_print(kind, out.text);
+   }
+}
+
+void send_cmd(const geometry_msgs::Twist & cmd) {
+   if( realtime ) {
+      control_out out;
+      out.kind = OUT_CMD;
+      out.linear = cmd.linear.x;
+      out.angular = cmd.angular.z;
+      control_send(out);
+   } else {
+      cmd_pub.publish(cmd);
+   }
+}
+
+void send_done(bool done) {
+   if( realtime ) {
+      control_out out;
+      out.kind = OUT_DONE;
+      out.done = done;
+      control_send(out);
+   } else {
+      std_msgs::Bool res;
+      res.data = done;
+      done_pub.publish(res);
+   }
+}
+
+// logs and publishes for the control thread, in the order it asked
+void controlOutThread() {
+   uint32_t dropped = 0;
+   while( ros::ok() ) {
+      sem_wait(&control_wake);
+      control_out out;
+      while( control_ring.pop(out) ) {
+         if( out.kind == OUT_CMD ) {
+            geometry_msgs::Twist cmd;
+            cmd.linear.x = out.linear;
+            cmd.angular.z = out.angular;
+            cmd_pub.publish(cmd);
+         } else if( out.kind == OUT_DONE ) {
+            std_msgs::Bool res;
+            res.data = out.done;
+            done_pub.publish(res);
+         } else {
+            control_print(out.kind, out.text);
+         }
+      }
+      if( control_dropped.load() != dropped ) {
+         dropped = control_dropped.load();
+         ROS_WARN_THROTTLE(5.0, "%u control thread messages dropped so far",
+               dropped);
+      }
+   }
+}
+
+// the arc planned last, waiting for the main thread to publish it. when
+//  real-time, the control thread doesn't spend time building and
+//  serializing a Path for display
+bool show_pending = false;
+loc show_start;
+double show_r;
+double show_l;
+ros::Timer show_timer;
+
+void show_arc(loc start, double r, double l) {
+   if( realtime ) {
+      show_pending = true;
+      show_start = start;
+      show_r = r;
+      show_l = l;
+   } else {
+      path_pub.publish(arcToPath(start, r, l));
+   }
+}
+
+void showCb(const ros::TimerEvent &) {
+   loc start;
+   double r, l;
+   {
+      PiMutex::scoped_lock lock(planner_mutex);
+      if( !show_pending ) return;
+      show_pending = false;
+      start = show_start;
+      r = show_r;
+      l = show_l;
+   }
+   path_pub.publish(arcToPath(start, r, l));
+}
 
 enum pstate {
    BACKING, FORWARD, CONE
@@ -252,10 +531,14 @@ pstate planner_state;
 ros::Time planner_timeout;
 loc backup_pose;
 
-visualization_msgs::Marker cones;
+// recent odometry, for placing sensor data by its timestamp
+OdomHistory odom_history;
 
-float cone;
-ros::Time cone_time;
+// the cone being tracked; see cone_servo.h
+ConeServo cone_servo(odom_history);
+// the last laser cone candidates. held so a camera bearing that arrives
+//  after them can still be matched against them
+visualization_msgs::Marker::ConstPtr cones;
 
 bool bump = false;
 
@@ -279,7 +562,7 @@ path plan_path(loc start, loc end) {
       planner_state = CONE;
       pattern_center = start;
       planner_timeout = ros::Time::now();
-      ROS_INFO("Starting cone tracking");
+      control_log(OUT_INFO, "Starting cone tracking");
    }
 
    switch(planner_state) {
@@ -297,41 +580,16 @@ path plan_path(loc start, loc end) {
          break;
       case CONE:
          {
-            // find nearest cone
-            /*
-            if( cones.points.size() > 0 ) {
-               geometry_msgs::Point cone = cones.points.front();
-               double cone_d = hypot(cone.x - start.x, cone.y - start.y);
-               BOOST_FOREACH(geometry_msgs::Point p, cones.points) {
-                  double d = hypot(p.x - start.x, p.y - start.y);
-                  if( d < cone_d ) {
-                     cone = p;
-                     cone_d = d;
-                  }
-               }
-               p.speed = min_speed * 4.0;
-               p.radius = 0;
-               double cone_angle = atan2(cone.y - start.y, cone.x - start.x);
-               double turn_angle = cone_angle - start.pose;
-               // normalize turn angle
-               while( turn_angle > M_PI ) turn_angle -= 2*M_PI;
-               while( turn_angle < -M_PI ) turn_angle += 2 * M_PI;
-
-               ROS_INFO("Angle to cone %lf", turn_angle);
-               if( turn_angle > 0.1 ) {
-                  p.radius = min_radius;
-                  ROS_INFO("Cone left");
-               }
-               if( turn_angle < -0.1 ) {
-                  p.radius = -min_radius;
-                  ROS_INFO("Cone right");
-               }
-               */
             p.speed = cone_speed;
-            if( (ros::Time::now() - cone_time).toSec() < cone_timeout ) {
-               p.radius = (p.speed / (cone * 1.4));
+            odom_pose now;
+            double k;
+            if( odom_history.latest(now) &&
+                  cone_servo.steer(now, p.speed, k) ) {
+               // no tighter than the robot can turn
+               k = max(-1.0 / min_radius, min(1.0 / min_radius, k));
+               p.radius = k != 0.0 ? 1.0 / k : 0.0;
             } else {
-               ROS_INFO("No cones");
+               control_log(OUT_INFO, "No cones");
                // if we don't see any cones, drive in spirals
                //  a figure-8 pattern is probably best, but it's also hard
 
@@ -379,24 +637,18 @@ path plan_path(loc start, loc end) {
                p.speed = 0;
                p.radius = 0;
 
-               ROS_INFO("Cone hit");
+               control_log(OUT_INFO, "Cone hit");
                active = false;
-
-               std_msgs::Bool res;
-               res.data = true;
-               done_pub.publish(res);
+               send_done(true);
             }
             if( planner_timeout + ros::Duration(60.0) < ros::Time::now() ) {
                planner_state = FORWARD;
                p.speed = 0;
                p.radius = 0;
 
-               ROS_INFO("Cone tracking timed out");
+               control_log(OUT_INFO, "Cone tracking timed out");
                active = false;
-
-               std_msgs::Bool res;
-               res.data = false;
-               done_pub.publish(res);
+               send_done(false);
             }
          }
          break;
@@ -405,13 +657,11 @@ path plan_path(loc start, loc end) {
          if( d < goal_err ) {
             p.speed = 0;
             p.radius = 0;
-            ROS_INFO("Goal reached");
+            control_log(OUT_INFO, "Goal reached");
             active = false;
-            std_msgs::Bool res;
-            res.data = true;
             if( (ros::Time::now() - done_time).toSec() > 0.5 ) {
                done_time = ros::Time::now();
-               done_pub.publish(res);
+               send_done(true);
             }
             break;
          }
@@ -452,7 +702,8 @@ path plan_path(loc start, loc end) {
 
          // if our turn radius is below our minimum radius, go straight
          if( fabs(radius) < min_radius ) {
-            ROS_INFO("Tangent arc radius too small; looping around. %lf", radius);
+            control_log(OUT_INFO,
+                  "Tangent arc radius too small; looping around. %lf", radius);
             radius = 0;
             // we should go forward by our minimum radius, and then loop around
             arc_len = min_radius;
@@ -464,11 +715,13 @@ path plan_path(loc start, loc end) {
 
          arc_len = min(arc_len, planner_lookahead);
 
-         if( !test_arc(start, radius, arc_len) ) {
-            ROS_WARN("Tangent arc failed");
+         if( !retest_arc(start, radius, arc_len) ) {
+            control_log(OUT_WARN, "Tangent arc failed");
 
-            // test various radii for traverse_dist
+            // every candidate is tested, so the pick is the one closest to
+            //  the goal, not whichever one we took last cycle
             list<double> arcs;
+            // test various radii for traverse_dist
             if( test_arc(start, 0, traverse_dist) ) {
                arcs.push_back(0);
             }
@@ -486,7 +739,7 @@ path plan_path(loc start, loc end) {
                }
             }
             if( arcs.size() == 0 ) {
-               ROS_WARN("No valid forward paths found");
+               control_log(OUT_WARN, "No valid forward paths found");
                speed = 0;
                radius = 0;
                if( planner_timeout.sec != 0 ) {
@@ -500,7 +753,7 @@ path plan_path(loc start, loc end) {
                      }
                      backup_pose = start;
                      planner_timeout = ros::Time::now();
-                     ROS_WARN("Robot stuck; backing up");
+                     control_log(OUT_WARN, "Robot stuck; backing up");
                   }
                } else {
                   planner_timeout = ros::Time::now();
@@ -526,19 +779,24 @@ path plan_path(loc start, loc end) {
                arc_len = fabs(best_r * M_PI / 2);
                if( best_r == 0.0 ) arc_len = traverse_dist;
                speed = min(max_speed, max_speed * (2.0 * arc_len / planner_lookahead));
-               nav_msgs::Path p = arcToPath(start, best_r, 
+               show_arc(start, best_r, min(traverse_dist, arc_len));
+               // tested in full by the search; warm-start from it
+               odom_pose m;
+               m.x = start.x;
+               m.y = start.y;
+               m.theta = start.pose;
+               keep_arc(correct(map_correction, m), best_r,
                      min(traverse_dist, arc_len));
-               path_pub.publish(p);
                // reset backup timer
                planner_timeout.sec = 0;
             }
          } else {
-            nav_msgs::Path p = arcToPath(start, radius, arc_len);
-            path_pub.publish(p);
+            show_arc(start, radius, arc_len);
             // reset backup timer
             planner_timeout.sec = 0;
          }
-         ROS_INFO("Traverse distance %lf, speed %lf", traverse_dist, speed);
+         control_log(OUT_INFO, "Traverse distance %lf, speed %lf",
+               traverse_dist, speed);
          p.radius = radius;
          p.speed = speed;
          break;
@@ -547,11 +805,6 @@ path plan_path(loc start, loc end) {
    return p;
 }
 
-// publisher for publishing movement commands
-ros::Publisher cmd_pub;
-// publisher for map
-ros::Publisher map_pub;
-
 bool path_valid = false;
 geometry_msgs::PointStamped goal_msg;
 
@@ -559,9 +812,47 @@ geometry_msgs::PointStamped goal_msg;
 // tf2 buffer
 tf2_ros::Buffer tf2_buffer;
 
+// the goal as received, until it's been transformed into the odometry
+//  frame. goals are transformed here on the main thread, so the control
+//  thread never waits on tf; only the main thread touches these
+geometry_msgs::PointStamped goal_received;
+bool goal_pending = false;
+ros::Timer goal_timer;
+
+// move a pending goal into the odometry frame and make it the goal, once
+//  tf and the odometry frame allow
+void transform_goal() {
+   if( !goal_pending ) return;
+   if( !have_position_frame.load(boost::memory_order_acquire) ) return;
+
+   geometry_msgs::PointStamped goal = goal_received;
+   if( goal.header.frame_id != position_frame ) {
+      std::string tf_err;
+      if( !tf2_buffer.canTransform(position_frame,
+               goal.header.frame_id, goal.header.stamp, &tf_err) ) {
+         ROS_ERROR_THROTTLE(1.0, "Cannot transform goal from %s frame to "
+               "%s frame: %s", goal.header.frame_id.c_str(),
+               position_frame.c_str(), tf_err.c_str());
+         return;
+      }
+      tf2_buffer.transform(goal_received, goal, position_frame);
+   }
+   goal_pending = false;
+
+   PiMutex::scoped_lock lock(planner_mutex);
+   goal_msg = goal;
+   active = true;
+}
+
 void goalCallback(const geometry_msgs::PointStamped::ConstPtr & msg) {
-  goal_msg = *msg;
-  active = true;
+   goal_received = *msg;
+   goal_pending = true;
+   transform_goal();
+}
+
+// retry goals tf couldn't transform yet
+void goalCb(const ros::TimerEvent &) {
+   transform_goal();
 }
 
 // the last location we were at.
@@ -570,31 +861,45 @@ loc last_loc;
 geometry_msgs::Pose last_pose;
    
 void positionCallback(const nav_msgs::Odometry::ConstPtr & msg) {
+   const double received = monotonic_now();
+   odom_latency.record((ros::Time::now() - msg->header.stamp).toSec());
+
    loc here;
    here.x = msg->pose.pose.position.x;
    here.y = msg->pose.pose.position.y;
    here.pose = tf::getYaw(msg->pose.pose.orientation);
 
+   odom_pose sample;
+   sample.stamp = msg->header.stamp.toSec();
+   sample.x = here.x;
+   sample.y = here.y;
+   sample.theta = here.pose;
+   odom_history.push(sample);
+
+   PiMutex::scoped_lock lock(planner_mutex);
+   control_wait.record(monotonic_now() - received);
+
    last_loc = here;
    last_pose = msg->pose.pose;
-   std::string pose_frame = msg->header.frame_id;
-   position_frame = pose_frame;
-
-   if( pose_frame != goal_msg.header.frame_id ) {
-     geometry_msgs::PointStamped tmp_goal;
-     std::string tf_err;
-     if( tf2_buffer.canTransform(pose_frame, goal_msg.header.frame_id,
-           goal_msg.header.stamp, &tf_err) ) {
-       tf2_buffer.transform(goal_msg, tmp_goal, pose_frame);
-       goal_msg = tmp_goal;
-     } else {
-       ROS_ERROR("Cannot transform goal from %s frame to %s frame: %s",
-           goal_msg.header.frame_id.c_str(), pose_frame.c_str(),
-           tf_err.c_str());
-       return;
-     }
+
+   const std::string & pose_frame = msg->header.frame_id;
+   if( !have_position_frame.load(boost::memory_order_acquire) ) {
+      position_frame = pose_frame;
+      have_position_frame.store(true, boost::memory_order_release);
+   } else if( pose_frame != position_frame ) {
+      static double warned = 0.0;
+      if( received - warned > 5.0 ) {
+         warned = received;
+         control_log(OUT_WARN, "Odometry moved from the %s frame to %s; "
+               "the map stays in %s", position_frame.c_str(),
+               pose_frame.c_str(), position_frame.c_str());
+      }
    }
 
+   // goals arrive already in the odometry frame; see transform_goal.
+   //  until the first one, there's nothing to plan or command
+   if( pose_frame != goal_msg.header.frame_id ) return;
+
    loc goal(goal_msg);
 
    if( active ) {
@@ -633,7 +938,7 @@ void positionCallback(const nav_msgs::Odometry::ConstPtr & msg) {
       //ROS_INFO("Target radius: %lf, angular: %lf", radius, cmd.angular.z);
 
       cmd.linear.x = speed;
-      ROS_INFO("Target speed: %lf", speed);
+      control_log(OUT_INFO, "Target speed: %lf", speed);
       /*
       if( dist(here, goal) > goal_err ) {
          cmd.linear.x = speed;
@@ -642,168 +947,879 @@ void positionCallback(const nav_msgs::Odometry::ConstPtr & msg) {
          cmd.angular.z = 0;
       }
       */
-      cmd_pub.publish(cmd);
+      lock.unlock();
+      send_cmd(cmd);
    } else {
+      lock.unlock();
       geometry_msgs::Twist cmd;
-      cmd_pub.publish(cmd);
+      send_cmd(cmd);
+   }
+   control_cycle.record(monotonic_now() - received);
+}
+
+// how far ahead of base_frame a scanner is (m), when tf doesn't say
+double laser_offset = 0.26;
+
+// skip raytracing beams that end in the same cell as their neighbour
+bool decimate_scans = true;
+
+// threads the raytracing of each batch of sensor data is split among, or
+//  NULL for just the thread integrating it
+WorkerPool * raytrace_pool = 0;
+// publisher for the fraction of beams skipped by decimation
+ros::Publisher decimation_pub;
+
+// a laser scanner feeding the map
+struct scan_source {
+   std::string topic;
+   ros::Subscriber sub;
+   // pose of the scanner in base_frame; looked up from tf once
+   bool have_extrinsic;
+   odom_pose extrinsic;
+   // header.seq of the last scan received. only touched by the scan
+   //  thread
+   bool have_seq;
+   uint32_t last_seq;
+};
+vector<scan_source> scan_sources;
+std::string base_frame = "base_link";
+
+// scans are received on a thread of their own, which only hands them to
+//  the integration pass through a ring (see spsc_ring.h), so a long
+//  integration or planning pass can't make the subscriber queues overflow.
+//  the ring holds a couple of seconds of scans from every scanner
+struct pending_scan {
+   sensor_msgs::LaserScan::ConstPtr msg;
+   int source;
+};
+SpscRing<pending_scan> scan_ring(256);
+// scans taken from the ring for the integration pass
+vector<pending_scan> pending_scans;
+
+// scans lost on the way in: the ring was full, or a scanner's sequence
+//  numbers skipped some. published as scans_dropped when it goes up
+boost::atomic<uint32_t> scans_dropped(0);
+uint32_t scans_dropped_published = 0;
+ros::Publisher dropped_pub;
+
+// how often pending scans are batched into the map (s)
+double integration_window = 0.05;
+ros::Timer integration_timer;
+
+void laserCallback(const sensor_msgs::LaserScan::ConstPtr & msg,
+      int source) {
+   // a gap in the sequence numbers is scans the transport dropped; a big
+   //  jump backwards is the driver restarting
+   scan_source & src = scan_sources[source];
+   const uint32_t skipped = msg->header.seq - src.last_seq - 1;
+   if( src.have_seq && skipped < 1000 ) scans_dropped += skipped;
+   src.have_seq = true;
+   src.last_seq = msg->header.seq;
+
+   pending_scan p;
+   p.msg = msg;
+   p.source = source;
+   if( !scan_ring.push(p) ) ++scans_dropped;
+}
+
+// pose of a scanner on the robot. extrinsics don't change, so they're
+//  cached after the first successful lookup
+odom_pose scan_extrinsic(scan_source & src, const std::string & frame_id) {
+   if( !src.have_extrinsic ) {
+      try {
+         geometry_msgs::TransformStamped t = tf2_buffer.lookupTransform(
+               base_frame, frame_id, ros::Time(0));
+         src.extrinsic.x = t.transform.translation.x;
+         src.extrinsic.y = t.transform.translation.y;
+         src.extrinsic.theta = tf::getYaw(t.transform.rotation);
+         src.have_extrinsic = true;
+         ROS_INFO("Scanner on %s at (%lf, %lf, %lf)", src.topic.c_str(),
+               src.extrinsic.x, src.extrinsic.y, src.extrinsic.theta);
+      } catch( tf2::TransformException & e ) {
+         ROS_WARN_THROTTLE(5.0, "No transform from %s to %s; "
+               "assuming the laser is %lf m ahead: %s", frame_id.c_str(),
+               base_frame.c_str(), laser_offset, e.what());
+         odom_pose fallback;
+         fallback.x = laser_offset;
+         return fallback;
+      }
    }
+   return src.extrinsic;
 }
 
-#define LOCAL_MAP_SIZE 150
-#define LASER_OFFSET 0.26
+// laser origin and direction for each beam of a scan
+struct scan_beams {
+   vector<double> x;
+   vector<double> y;
+   vector<double> theta;
+   // robot pose at the first beam
+   odom_pose start;
+};
 
-void laserCallback(const sensor_msgs::LaserScan::ConstPtr & msg) {
-   //map_center_x = last_loc.x;
-   //map_center_y = last_loc.y;
-   loc here = last_loc;
+// place every beam of a scan, corrected for the robot's motion during the
+//  sweep
+void place_beams(const sensor_msgs::LaserScan & scan, scan_source & src,
+      scan_beams & beams) {
+   const unsigned int n = scan.ranges.size();
+
+   // robot pose at the first and last beam of the scan
+   odom_pose end;
+   double scan_start = scan.header.stamp.toSec();
+   double scan_end = scan_start + scan.time_increment * (n - 1);
+   if( !odom_history.lookup(scan_start, beams.start) ||
+         !odom_history.lookup(scan_end, end) ) {
+      ROS_WARN_THROTTLE(1.0, "No odometry at scan time; using last position");
+      beams.start.stamp = scan_start;
+      {
+         // the control thread writes last_loc
+         PiMutex::scoped_lock lock(planner_mutex);
+         beams.start.x = last_loc.x;
+         beams.start.y = last_loc.y;
+         beams.start.theta = last_loc.pose;
+      }
+      end = beams.start;
+   }
 
-   double theta_base = last_loc.pose;
+   beams.x.resize(n);
+   beams.y.resize(n);
+   beams.theta.resize(n);
+   deskew_beams(beams.start, end, scan_extrinsic(src, scan.header.frame_id),
+         scan.angle_min, scan.angle_increment, n,
+         &beams.x[0], &beams.y[0], &beams.theta[0]);
+}
 
-   double theta = theta_base + msg->angle_min;
-   double x;
-   double y;
+// scan matching
+bool match_scans = true;
+// search window (m, rad) and time budget (s)
+double match_window = 0.3;
+double match_angle = 0.1;
+double match_budget = 0.005;
+// fewest mean depth, in cells, a match needs before we trust it
+#define MIN_MATCH_SCORE 1.0
+
+ScanMatcher scan_matcher;
+std::string map_frame = "map";
+tf2_ros::TransformBroadcaster * correction_broadcaster;
+
+// apply c to every beam origin and direction
+void correct_beams(const correction & c, vector<scan_beams> & beams) {
+   const double cs = cos(c.theta);
+   const double sn = sin(c.theta);
+   for( size_t p=0; p<beams.size(); p++ ) {
+      scan_beams & b = beams[p];
+      for( size_t i=0; i<b.x.size(); i++ ) {
+         double x = b.x[i];
+         b.x[i] = cs*x - sn*b.y[i] + c.x;
+         b.y[i] = sn*x + cs*b.y[i] + c.y;
+         b.theta[i] += c.theta;
+      }
+      b.start = correct(c, b.start);
+   }
+}
 
-   double offset_x = modf(here.x/MAP_RES, &x)*MAP_RES; // don't care about x
-   double offset_y = modf(here.y/MAP_RES, &y)*MAP_RES; // don't care about y
+// match the pending scans against the map window last read into
+//  scan_matcher, from the robot at here. true if delta holds a
+//  trustworthy correction. doesn't touch the map, so needs no lock
+bool match_beams(const odom_pose & here, const vector<scan_beams> & beams,
+      correction & delta) {
+   static vector<double> px;
+   static vector<double> py;
+   px.clear();
+   py.clear();
+   for( size_t p=0; p<pending_scans.size(); p++ ) {
+      const sensor_msgs::LaserScan & msg = *pending_scans[p].msg;
+      const scan_beams & b = beams[p];
+      for( unsigned int i=0; i<b.x.size(); i++ ) {
+         double r = msg.ranges[i];
+         if( r > msg.range_min && r < msg.range_max ) {
+            px.push_back(b.x[i] + r*cos(b.theta[i]) - here.x);
+            py.push_back(b.y[i] + r*sin(b.theta[i]) - here.y);
+         }
+      }
+   }
 
-   // manual laser transform. I'm a horrible person
-   offset_x += LASER_OFFSET * cos(theta_base);
-   offset_y += LASER_OFFSET * sin(theta_base);
+   if( !scan_matcher.match(here.x, here.y, px, py,
+            match_window, match_angle, match_budget, delta) ) {
+      return false;
+   }
+   return scan_matcher.score() >= MIN_MATCH_SCORE;
+}
 
-   map_type * local_map = (map_type*)malloc(LOCAL_MAP_SIZE*LOCAL_MAP_SIZE*
-         sizeof(map_type));
-   memset(local_map, 0, LOCAL_MAP_SIZE*LOCAL_MAP_SIZE*sizeof(map_type));
-   int j, k;
-   
-   // build a local map and merge it with the global map
+// publish the drift correction as the map -> odometry transform
+void publish_correction(double stamp) {
+   if( !have_position_frame ) return;
+   geometry_msgs::TransformStamped t;
+   t.header.stamp = ros::Time(stamp);
+   t.header.frame_id = map_frame;
+   t.child_frame_id = position_frame;
+   t.transform.translation.x = map_correction.x;
+   t.transform.translation.y = map_correction.y;
+   t.transform.rotation = tf::createQuaternionMsgFromYaw(
+         map_correction.theta);
+   correction_broadcaster->sendTransform(t);
+}
 
-   // for each laser scan point, raytrace
-   for( unsigned int i=0; i<msg->ranges.size(); i++, 
-         theta += msg->angle_increment ) {
-      double d;
-      double r = msg->ranges[i];
-      int status = 1;
-      if( r < msg->range_min ) {
-         // pull status codes out of laser data according to SCIP1.1
-         if( r == 0.0 ) {
-            r = 22.0; // raytrace out to 22m
-         } else if( 0.0055 < r && r < 0.0065 ) {
-            r = 5.7;
-         } else if( 0.0155 < r && r < 0.0165 ) {
-            r = 5.0;
-         } else {
-            status = 0;
+// integrate every pending scan in one pass: one local map, a raytrace per
+//  scan, one merge. Adding a sensor costs raytraces, not map passes
+void integrate_scans() {
+   pending_scan received;
+   while( scan_ring.pop(received) ) pending_scans.push_back(received);
+
+   const uint32_t dropped = scans_dropped.load();
+   if( dropped != scans_dropped_published ) {
+      ROS_WARN_THROTTLE(5.0, "%u scans dropped so far", dropped);
+      std_msgs::UInt32 d;
+      d.data = dropped;
+      dropped_pub.publish(d);
+      scans_dropped_published = dropped;
+   }
+
+   if( pending_scans.empty() ) return;
+
+   static vector<scan_beams> beams;
+   beams.resize(pending_scans.size());
+
+   // the local map is centered on the map cell under the robot, as of the
+   //  newest scan
+   odom_pose newest;
+   bool have_newest = false;
+   for( size_t p=0; p<pending_scans.size(); p++ ) {
+      const sensor_msgs::LaserScan & msg = *pending_scans[p].msg;
+      if( msg.ranges.empty() ) {
+         beams[p].x.clear();
+         continue;
+      }
+      place_beams(msg, scan_sources[pending_scans[p].source], beams[p]);
+      if( !have_newest || beams[p].start.stamp > newest.stamp ) {
+         newest = beams[p].start;
+         have_newest = true;
+      }
+   }
+   if( !have_newest ) {
+      pending_scans.clear();
+      return;
+   }
+
+   // move everything into the map frame, then refine that against the map
+   correct_beams(map_correction, beams);
+   newest = correct(map_correction, newest);
+   if( match_scans ) {
+      {
+         // reading the window can write the map (lazy decay); the search
+         //  runs on the copy, outside the lock
+         PiMutex::scoped_lock lock(planner_mutex);
+         scan_matcher.read(*obstacle_map, newest.x, newest.y);
+      }
+      correction delta;
+      if( match_beams(newest, beams, delta) ) {
+         {
+            PiMutex::scoped_lock lock(planner_mutex);
+            map_correction = compose(delta, map_correction);
          }
+         correct_beams(delta, beams);
+         newest = correct(delta, newest);
       }
-      if( status ) {
-         for( d=0; d<r; d += MAP_RES/2.0 ) {
-            x = offset_x + d*cos(theta);
-            y = offset_y + d*sin(theta);
+      publish_correction(newest.stamp);
+   }
 
-            j = round(x/MAP_RES) + LOCAL_MAP_SIZE/2;
-            k = round(y/MAP_RES) + LOCAL_MAP_SIZE/2;
-            if( j > 0 && k > 0 && j < LOCAL_MAP_SIZE && k < LOCAL_MAP_SIZE ) {
-               local_map[j*LOCAL_MAP_SIZE + k] = -1;
+   // build a local map and merge it with the global map
+   obstacle_map->local_clear(newest.x, newest.y);
+   const double res = obstacle_map->resolution();
+
+   unsigned int rays = 0;
+   static local_rays traced;
+   traced.clear();
+
+   // for each laser scan point, raytrace
+   for( size_t p=0; p<pending_scans.size(); p++ ) {
+      const sensor_msgs::LaserScan & msg = *pending_scans[p].msg;
+      const scan_beams & b = beams[p];
+
+      // adaptive decimation: near the robot, neighbouring beams end in the
+      //  same cell and trace the same free space. Only raytrace a beam if
+      //  its endpoint is at least a cell away from the last beam we traced.
+      //  obstacle endpoints are all still marked below
+      double last_x = 0.0;
+      double last_y = 0.0;
+      bool have_last = false;
+
+      for( unsigned int i=0; i<b.x.size(); i++ ) {
+         double r = msg.ranges[i];
+         int status = 1;
+         if( r < msg.range_min ) {
+            // pull status codes out of laser data according to SCIP1.1
+            if( r == 0.0 ) {
+               r = 22.0; // raytrace out to 22m
+            } else if( 0.0055 < r && r < 0.0065 ) {
+               r = 5.7;
+            } else if( 0.0155 < r && r < 0.0165 ) {
+               r = 5.0;
             } else {
-               break; // if we step outside the local map bounds, we're done
+               status = 0;
             }
          }
+         if( status ) {
+            double c = cos(b.theta[i]);
+            double s = sin(b.theta[i]);
+            ++rays;
+            if( decimate_scans ) {
+               double end_x = b.x[i] + r*c;
+               double end_y = b.y[i] + r*s;
+               if( have_last &&
+                     hypot(end_x - last_x, end_y - last_y) < res ) {
+                  continue;
+               }
+               last_x = end_x;
+               last_y = end_y;
+               have_last = true;
+            }
+            local_ray ray = { b.x[i], b.y[i], c, s, r };
+            traced.push_back(ray);
+         }
       }
    }
-   
+   obstacle_map->local_raytrace(traced, raytrace_pool);
+
+   if( rays > 0 ) {
+      std_msgs::Float32 skip;
+      skip.data = 1.0 - (double)traced.size() / rays;
+      decimation_pub.publish(skip);
+   }
+
    // mark obstacles
-   theta = theta_base + msg->angle_min;
-   for( unsigned int i=0; i<msg->ranges.size(); i++, 
-         theta += msg->angle_increment ) {
-      if( msg->ranges[i] > msg->range_min ) {
-         x = offset_x + msg->ranges[i]*cos(theta);
-         y = offset_y + msg->ranges[i]*sin(theta);
-
-         j = round(x/MAP_RES) + LOCAL_MAP_SIZE/2;
-         k = round(y/MAP_RES) + LOCAL_MAP_SIZE/2;
-         if( j > 0 && k > 0 && j < LOCAL_MAP_SIZE && k < LOCAL_MAP_SIZE ) {
-            local_map[j*LOCAL_MAP_SIZE + k] = 1;
+   for( size_t p=0; p<pending_scans.size(); p++ ) {
+      const sensor_msgs::LaserScan & msg = *pending_scans[p].msg;
+      const scan_beams & b = beams[p];
+      for( unsigned int i=0; i<b.x.size(); i++ ) {
+         if( msg.ranges[i] > msg.range_min ) {
+            obstacle_map->local_mark(
+                  b.x[i] + msg.ranges[i]*cos(b.theta[i]),
+                  b.y[i] + msg.ranges[i]*sin(b.theta[i]));
          }
       }
    }
 
-   // grow obstacles by radius of robot; makes collision-testing easier
-   // order: O(n^2 * 12)
-   for( int r=1; r<(0.4/MAP_RES); r++ ) {
-      for( int i=0; i<LOCAL_MAP_SIZE; i++ ) {
-         for( int j=0; j<LOCAL_MAP_SIZE; j++ ) {
-            if( local_map[i*LOCAL_MAP_SIZE + j] <= 0 ) {
-               if( i > 0   && local_map[(i-1)*LOCAL_MAP_SIZE + j  ] == r ) 
-                  local_map[i*LOCAL_MAP_SIZE + j] = r+1;
-               if( j > 0   && local_map[i*LOCAL_MAP_SIZE + j-1] == r )
-                  local_map[i*LOCAL_MAP_SIZE + j] = r+1;
-               if( i < LOCAL_MAP_SIZE && 
-                     local_map[(i+1)*LOCAL_MAP_SIZE + j  ] == r )
-                  local_map[i*LOCAL_MAP_SIZE + j] = r+1;
-               if( j < LOCAL_MAP_SIZE && 
-                     local_map[i*LOCAL_MAP_SIZE + j+1] == r ) 
-                  local_map[i*LOCAL_MAP_SIZE + j] = r+1;
-            }
+   {
+      PiMutex::scoped_lock lock(planner_mutex);
+      obstacle_map->local_merge(newest.x, newest.y, newest.theta);
+   }
+   pending_scans.clear();
+   return;
+}
+
+void integrateCb(const ros::TimerEvent &) {
+   integrate_scans();
+}
+
+// height band for point cloud obstacles (m). points below cloud_min_z are
+//  ground, and only count as free space
+double cloud_min_z = 0.1;
+double cloud_max_z = 1.0;
+
+// scratch bins for point cloud downsampling; same layout as the local map
+CloudBins * cloud_bins;
+
+void cloudCallback(const sensor_msgs::PointCloud2::ConstPtr & msg) {
+   if( !have_position_frame ) return;
+
+   // find the coordinates in the raw point buffer
+   cloud_layout layout;
+   layout.width = msg->width;
+   layout.height = msg->height;
+   layout.point_step = msg->point_step;
+   layout.row_step = msg->row_step;
+   int found = 0;
+   for( size_t i=0; i<msg->fields.size(); i++ ) {
+      const sensor_msgs::PointField & f = msg->fields[i];
+      if( f.datatype != sensor_msgs::PointField::FLOAT32 ) continue;
+      if( f.name == "x" ) {
+         layout.x_offset = f.offset;
+         found |= 1;
+      } else if( f.name == "y" ) {
+         layout.y_offset = f.offset;
+         found |= 2;
+      } else if( f.name == "z" ) {
+         layout.z_offset = f.offset;
+         found |= 4;
+      }
+   }
+   if( found != 7 ) {
+      ROS_ERROR_THROTTLE(5.0, "Point cloud has no FLOAT32 x, y and z fields");
+      return;
+   }
+   if( msg->is_bigendian ) {
+      ROS_ERROR_THROTTLE(5.0, "Big-endian point clouds are not supported");
+      return;
+   }
+   if( msg->data.size() < layout.row_step * layout.height ) {
+      ROS_ERROR_THROTTLE(5.0, "Point cloud data is truncated");
+      return;
+   }
+
+   // sensor pose in the odometry frame, at the time of the cloud
+   geometry_msgs::TransformStamped sensor;
+   try {
+      sensor = tf2_buffer.lookupTransform(position_frame,
+            msg->header.frame_id, msg->header.stamp, ros::Duration(0.1));
+   } catch( tf2::TransformException & e ) {
+      ROS_ERROR_THROTTLE(5.0, "Cannot place point cloud: %s", e.what());
+      return;
+   }
+   cloud_transform xf;
+   const geometry_msgs::Quaternion & q = sensor.transform.rotation;
+   xf.r[0] = 1 - 2*(q.y*q.y + q.z*q.z);
+   xf.r[1] = 2*(q.x*q.y - q.z*q.w);
+   xf.r[2] = 2*(q.x*q.z + q.y*q.w);
+   xf.r[3] = 2*(q.x*q.y + q.z*q.w);
+   xf.r[4] = 1 - 2*(q.x*q.x + q.z*q.z);
+   xf.r[5] = 2*(q.y*q.z - q.x*q.w);
+   xf.r[6] = 2*(q.x*q.z - q.y*q.w);
+   xf.r[7] = 2*(q.y*q.z + q.x*q.w);
+   xf.r[8] = 1 - 2*(q.x*q.x + q.y*q.y);
+   xf.t[0] = sensor.transform.translation.x;
+   xf.t[1] = sensor.transform.translation.y;
+   xf.t[2] = sensor.transform.translation.z;
+
+   // odometry frame to map frame
+   {
+      const double cs = cos(map_correction.theta);
+      const double sn = sin(map_correction.theta);
+      for( int c=0; c<3; c++ ) {
+         double r0 = xf.r[c];
+         xf.r[c] = cs*r0 - sn*xf.r[3 + c];
+         xf.r[3 + c] = sn*r0 + cs*xf.r[3 + c];
+      }
+      double t0 = xf.t[0];
+      xf.t[0] = cs*t0 - sn*xf.t[1] + map_correction.x;
+      xf.t[1] = sn*t0 + cs*xf.t[1] + map_correction.y;
+   }
+
+   // robot pose at the time of the cloud
+   odom_pose pose;
+   if( !odom_history.lookup(msg->header.stamp.toSec(), pose) ) {
+      PiMutex::scoped_lock lock(planner_mutex);
+      pose.x = last_loc.x;
+      pose.y = last_loc.y;
+      pose.theta = last_loc.pose;
+   }
+   pose = correct(map_correction, pose);
+   // the bins share the local map's center cell
+   obstacle_map->local_clear(pose.x, pose.y);
+   double center_x;
+   double center_y;
+   obstacle_map->local_center(center_x, center_y);
+   const double res = obstacle_map->resolution();
+   const int L = obstacle_map->local_size();
+
+   cloud_bins->bin(&msg->data[0], layout, xf, center_x, center_y,
+         cloud_min_z, cloud_max_z);
+   const vector<int> & cells = cloud_bins->cells();
+
+   // one raytrace per occupied bin, from the sensor to the bin
+   static local_rays rays;
+   rays.clear();
+   for( size_t i=0; i<cells.size(); i++ ) {
+      double dx = (cells[i] / L - L/2) * res + center_x - xf.t[0];
+      double dy = (cells[i] % L - L/2) * res + center_y - xf.t[1];
+      double r = hypot(dx, dy);
+      if( r > 0 ) {
+         local_ray ray = { xf.t[0], xf.t[1], dx / r, dy / r, r };
+         rays.push_back(ray);
+      }
+   }
+   obstacle_map->local_raytrace(rays, raytrace_pool);
+   for( size_t i=0; i<cells.size(); i++ ) {
+      if( cloud_bins->at(cells[i]) == CloudBins::OBSTACLE ) {
+         obstacle_map->local_mark(
+               (cells[i] / L - L/2) * res + center_x,
+               (cells[i] % L - L/2) * res + center_y);
+      }
+   }
+   cloud_bins->clear();
+
+   PiMutex::scoped_lock lock(planner_mutex);
+   obstacle_map->local_merge(pose.x, pose.y, pose.theta);
+}
+
+// advance the decay epoch; tiles catch up lazily
+ros::Timer decay_timer;
+
+void decayCb(const ros::TimerEvent &) {
+   PiMutex::scoped_lock lock(planner_mutex);
+   obstacle_map->advance_epoch();
+}
+
+// decay a few tiles each tick, so the control thread seldom finds one
+//  stale in the middle of planning. a tick is bounded, not a sweep; any
+//  tile not reached yet still decays when it's read
+#define DECAY_CATCH_UP_TILES 16
+ros::Timer catch_up_timer;
+
+void catchUpCb(const ros::TimerEvent &) {
+   PiMutex::scoped_lock lock(planner_mutex);
+   obstacle_map->catch_up(DECAY_CATCH_UP_TILES);
+}
+
+// the map, and the robot's pose on it, in shared memory for other
+//  processes on the robot; see map_shm.h. map_shm_bridge turns it into an
+//  OccupancyGrid for anything that wants one
+MapShmWriter * map_shm = 0;
+ros::Timer map_shm_timer;
+
+// tiles copied per hold of planner_mutex; a 64x64 tile is 4k, so about
+//  1MB at a time. the first pass copies the whole map
+#define MAP_SHM_BATCH 256
+
+void mapShmCb(const ros::TimerEvent &) {
+   do {
+      PiMutex::scoped_lock lock(planner_mutex);
+      odom_pose pose;
+      if( odom_history.latest(pose) ) pose = correct(map_correction, pose);
+      if( !map_shm->publish(*obstacle_map, map_frame, pose.stamp, pose.x,
+               pose.y, pose.theta, MAP_SHM_BATCH) ) {
+         ROS_WARN_THROTTLE(10.0, "Can't publish the map to shared memory");
+         return;
+      }
+   } while( map_shm->partway() );
+}
+
+// memory held by each subsystem, for finding allocations made every cycle
+//  and sizing things to the robot's RAM; see mem_account.h
+ros::Publisher memory_pub;
+ros::Timer memory_timer;
+
+// names for the tags in mem_account.h, in order
+const char * const mem_tag_names[MEM_TAGS] = {
+   "map", "pyramid", "local", "sensors", "matcher", "share"
+};
+
+void memoryCb(const ros::TimerEvent &) {
+   mem_account::MemoryUsage m;
+   mem_report(m);
+   memory_pub.publish(m);
+}
+
+// keep the map around the robot faulted in from a background thread, so
+//  integration and planning don't take the page faults when we drive into
+//  new territory. 0 disables
+double prefault_radius = 25.0;
+// held by the prefault thread while it uses the map, so it can't be
+//  swapped out from under it
+boost::mutex map_swap_mutex;
+
+void prefaultThread() {
+   ros::WallRate rate(2.0);
+   while( ros::ok() ) {
+      odom_pose pose;
+      if( odom_history.latest(pose) ) {
+         boost::mutex::scoped_lock lock(map_swap_mutex);
+         obstacle_map->prefault(pose.x, pose.y, prefault_radius);
+      }
+      rate.sleep();
+   }
+}
+
+// the UTM frame, which keepout zones and shared maps are placed through
+std::string utm_frame = "utm";
+
+// the pose of the UTM frame in the position frame. false, with the reason
+//  in error, if there's no transform yet
+bool utm_pose(odom_pose & utm, std::string & error) {
+   try {
+      geometry_msgs::TransformStamped t = tf2_buffer.lookupTransform(
+            position_frame, utm_frame, ros::Time(0));
+      utm.x = t.transform.translation.x;
+      utm.y = t.transform.translation.y;
+      utm.theta = tf::getYaw(t.transform.rotation);
+      return true;
+   } catch( tf2::TransformException & e ) {
+      error = e.what();
+      return false;
+   }
+}
+
+// keepout zones, and where they were last rasterized onto the map. a zone
+//  is placed through the utm -> odom transform (for UTM zones) and the scan
+//  matcher's correction, and the map is only re-rasterized when that moves
+//  some vertex by more than half a cell; queries just read the composited
+//  cost, so keepouts cost the planner nothing
+vector<keepout_zone> keepout_zones;
+vector<keepout_zone> keepout_placed;
+ros::Timer keepout_timer;
+
+double xml_double(XmlRpc::XmlRpcValue & v) {
+   if( v.getType() == XmlRpc::XmlRpcValue::TypeInt ) return (int)v;
+   return (double)v;
+}
+
+// zones from a parameter: a list of {frame: utm|odom, points: [x, y, ...]}
+bool keepout_param(XmlRpc::XmlRpcValue & param,
+      vector<keepout_zone> & zones) {
+   if( param.getType() != XmlRpc::XmlRpcValue::TypeArray ) return false;
+   for( int k=0; k<param.size(); k++ ) {
+      XmlRpc::XmlRpcValue & z = param[k];
+      if( z.getType() != XmlRpc::XmlRpcValue::TypeStruct ||
+            !z.hasMember("frame") || !z.hasMember("points") ) {
+         return false;
+      }
+      XmlRpc::XmlRpcValue & points = z["points"];
+      std::string frame = z["frame"];
+      if( (frame != "utm" && frame != "odom") ||
+            points.getType() != XmlRpc::XmlRpcValue::TypeArray ||
+            points.size() < 6 || points.size() % 2 != 0 ) {
+         return false;
+      }
+      keepout_zone zone;
+      zone.utm = frame == "utm";
+      for( int i=0; i<points.size(); i += 2 ) {
+         zone.x.push_back(xml_double(points[i]));
+         zone.y.push_back(xml_double(points[i+1]));
+      }
+      zones.push_back(zone);
+   }
+   return true;
+}
+
+void keepoutCb(const ros::TimerEvent &) {
+   if( keepout_zones.empty() || !have_position_frame ) return;
+
+   // utm -> odom, if any zone needs it
+   odom_pose utm;
+   std::string error;
+   const bool have_utm = utm_pose(utm, error);
+   if( !have_utm ) {
+      ROS_WARN_THROTTLE(30.0, "No transform from %s to %s; "
+            "UTM keepout zones not placed: %s", utm_frame.c_str(),
+            position_frame.c_str(), error.c_str());
+   }
+   const correction c = map_correction;
+   const double cu = cos(utm.theta);
+   const double su = sin(utm.theta);
+
+   vector<keepout_zone> placed;
+   for( size_t k=0; k<keepout_zones.size(); k++ ) {
+      const keepout_zone & zone = keepout_zones[k];
+      if( zone.utm && !have_utm ) continue;
+      keepout_zone p;
+      p.utm = zone.utm;
+      for( size_t i=0; i<zone.x.size(); i++ ) {
+         odom_pose v;
+         v.x = zone.x[i];
+         v.y = zone.y[i];
+         if( zone.utm ) {
+            v.x = cu*zone.x[i] - su*zone.y[i] + utm.x;
+            v.y = su*zone.x[i] + cu*zone.y[i] + utm.y;
          }
+         v = correct(c, v);
+         p.x.push_back(v.x);
+         p.y.push_back(v.y);
       }
+      placed.push_back(p);
    }
 
-   // merge into global map
-   offset_x = round(here.x/MAP_RES)*MAP_RES;
-   offset_y = round(here.y/MAP_RES)*MAP_RES;
-   for( int i=0; i<LOCAL_MAP_SIZE; i++ ) {
-      for( int j=0; j<LOCAL_MAP_SIZE; j++ ) {
-         x = (i - LOCAL_MAP_SIZE/2) * MAP_RES + offset_x;
-         y = (j - LOCAL_MAP_SIZE/2) * MAP_RES + offset_y;
-         map_type tmp = 0;
-         tmp += local_map[i*LOCAL_MAP_SIZE + j];
-         if( tmp > 0 ) tmp = 2; // flatten obstacle radius
-         tmp += map_get(x, y);
-         if( tmp > 4 ) tmp = 4;
-         if( tmp < 0 ) tmp = 0;
-         map_set(x, y, tmp);
+   // the anchor hasn't moved enough to change any cell; keep what we have
+   bool moved = placed.size() != keepout_placed.size();
+   const double tolerance = obstacle_map->resolution() / 2.0;
+   for( size_t k=0; !moved && k<placed.size(); k++ ) {
+      for( size_t i=0; i<placed[k].x.size(); i++ ) {
+         if( hypot(placed[k].x[i] - keepout_placed[k].x[i],
+                  placed[k].y[i] - keepout_placed[k].y[i]) > tolerance ) {
+            moved = true;
+            break;
+         }
       }
    }
+   if( !moved ) return;
+
+   PiMutex::scoped_lock lock(planner_mutex);
+   obstacle_map->clear_keepout();
+   for( size_t k=0; k<placed.size(); k++ ) {
+      obstacle_map->add_keepout(placed[k].x, placed[k].y);
+   }
+   keepout_placed.swap(placed);
+}
+
+// obstacle evidence shared with the other robots on the course; see
+//  map_share.h. the shared frame is the UTM frame less share_origin, and
+//  every robot's planner sends and receives on map_deltas
+class RosShareTransport : public MapShareTransport {
+   public:
+      explicit RosShareTransport(ros::NodeHandle & n) {
+         pub_ = n.advertise<path_planner::MapDeltas>("map_deltas", 10);
+         sub_ = n.subscribe("map_deltas", 10,
+               &RosShareTransport::deltasCb, this);
+      }
+
+      virtual void send(const std::vector<uint8_t> & batch) {
+         path_planner::MapDeltas msg;
+         msg.header.stamp = ros::Time::now();
+         msg.header.frame_id = utm_frame;
+         msg.data = batch;
+         pub_.publish(msg);
+      }
+
+      // batches arrive on the same thread the planner runs on, so they
+      //  just wait here until it asks
+      virtual bool receive(std::vector<uint8_t> & batch) {
+         if( inbox_.empty() ) return false;
+         batch.swap(inbox_.front());
+         inbox_.pop_front();
+         return true;
+      }
 
-   // clear out base footprint
-   theta = here.pose;
-   for( double bx = -0.16; bx <= 0.16; bx += MAP_RES/2.0 ) {
-      for( double by = -0.17; by < 0.45; by += MAP_RES/2.0 ) {
-         x = bx*cos(theta) + here.x;
-         y = by*sin(theta) + here.y;
-         map_set(x, y, 0);
+   private:
+      void deltasCb(const path_planner::MapDeltas::ConstPtr & msg) {
+         inbox_.push_back(msg->data);
       }
+
+      ros::Publisher pub_;
+      ros::Subscriber sub_;
+      std::deque<std::vector<uint8_t> > inbox_;
+};
+
+RosShareTransport * share_transport = 0;
+MapShare * map_share = 0;
+double share_origin_x = 0.0;
+double share_origin_y = 0.0;
+// bytes/s sent, and the bytes that allows sending now
+double share_bandwidth = 10000.0;
+double share_budget = 0.0;
+ros::Timer share_timer;
+
+void shareCb(const ros::TimerEvent & e) {
+   odom_pose utm;
+   std::string error;
+   if( !have_position_frame || !utm_pose(utm, error) ) {
+      ROS_WARN_THROTTLE(30.0, "No transform from %s to %s; "
+            "map not shared: %s", utm_frame.c_str(),
+            position_frame.c_str(), error.c_str());
+      return;
    }
 
-   free(local_map);
+   // the shared frame's origin in the map frame
+   const double cu = cos(utm.theta);
+   const double su = sin(utm.theta);
+   odom_pose origin;
+   origin.x = cu*share_origin_x - su*share_origin_y + utm.x;
+   origin.y = su*share_origin_x + cu*share_origin_y + utm.y;
+   origin.theta = utm.theta;
+   origin = correct(map_correction, origin);
+   share_frame frame;
+   frame.x = origin.x;
+   frame.y = origin.y;
+   frame.theta = origin.theta;
+
+   PiMutex::scoped_lock lock(planner_mutex);
+   map_share->receive(*obstacle_map, frame);
+
+   // the budget fills at the bandwidth cap, up to a second of it
+   if( !e.last_real.isZero() ) {
+      share_budget += share_bandwidth * (e.current_real -
+            e.last_real).toSec();
+   }
+   share_budget = std::min(share_budget, share_bandwidth);
+   share_budget -= map_share->send(*obstacle_map, frame, share_budget);
+}
 
-   /*
-   static int div = 0;
-   ++div;
-   if( div % 20 == 0 ) {
-      // publish map
-      nav_msgs::OccupancyGrid map;
-      map.header = msg->header;
-      map.header.frame_id = "odom";
-      map.info.resolution = MAP_RES;
-      map.info.width = MAP_SIZE;
-      map.info.height = MAP_SIZE; 
-      map.info.origin.position.x = - (MAP_SIZE * MAP_RES) / 2.0;
-      map.info.origin.position.y = - (MAP_SIZE * MAP_RES) / 2.0;
-      map.info.origin.orientation.w = 1.0;
-      for( int i=0; i<MAP_SIZE; i++ ) {
-         for( int j=0; j<MAP_SIZE; j++ ) {
-            map.data.push_back(map_data[(j * MAP_SIZE) + i]);
+// when the map geometry is reconfigured, a new map is built and the old
+//  one resampled into it on a worker thread, while the old map stays in
+//  use. the main thread swaps them once the worker is done. whatever the
+//  sensors add to the old map during the rebuild is lost, and seen again
+//  by the next scans
+struct map_geometry {
+   int size;
+   double resolution;
+   int local_size;
+};
+map_geometry map_wanted;
+map_pages map_pages_wanted = PAGES_TRANSPARENT;
+int map_numa_node = -1;
+ros::Timer rebuild_timer;
+
+// main thread only
+bool map_rebuilding = false;
+// handed back by the worker
+boost::mutex map_rebuild_mutex;
+bool map_rebuild_done = false;
+ObstacleMap * map_rebuilt = 0;
+
+bool map_is(const ObstacleMap * m, const map_geometry & g) {
+   return m->size() == g.size && m->local_size() == g.local_size &&
+      fabs(m->resolution() - g.resolution) < 1e-4;
+}
+
+void rebuildThread(const ObstacleMap * old, map_geometry g) {
+   ObstacleMap * m = ObstacleMap::create(g.size, g.resolution,
+         map_pages_wanted, map_numa_node, g.local_size);
+   if( m ) {
+      // the old map is still being updated, so it's read a band of rows at
+      //  a time under planner_mutex; integration and the control thread
+      //  only ever wait for one band
+      const int band = 16;
+      for( int i=0; i<m->size(); i += band ) {
+         PiMutex::scoped_lock lock(planner_mutex);
+         m->resample(*old, i, std::min(i + band, m->size()) - 1);
+      }
+   }
+   boost::mutex::scoped_lock lock(map_rebuild_mutex);
+   map_rebuilt = m;
+   map_rebuild_done = true;
+}
+
+// unmapping a big map takes a while; keep it off the main thread
+void destroyMap(ObstacleMap * m) {
+   delete m;
+}
+
+void rebuildCb(const ros::TimerEvent &) {
+   if( map_rebuilding ) {
+      ObstacleMap * m;
+      {
+         boost::mutex::scoped_lock lock(map_rebuild_mutex);
+         if( !map_rebuild_done ) return;
+         m = map_rebuilt;
+      }
+      if( m ) {
+         // the prefault thread has the old map; try again next time
+         boost::mutex::scoped_try_lock lock(map_swap_mutex);
+         if( !lock.owns_lock() ) return;
+         ObstacleMap * old = obstacle_map;
+         {
+            PiMutex::scoped_lock planner_lock(planner_mutex);
+            obstacle_map = m;
+            // don't trust stamps from the old map
+            last_arc.valid = false;
          }
+         lock.unlock();
+
+         delete cloud_bins;
+         cloud_bins = new CloudBins(m->local_size(), m->resolution());
+         // re-rasterize keepout zones onto the new grid
+         keepout_placed.clear();
+         boost::thread(destroyMap, old).detach();
+         ROS_INFO("Map rebuilt: %d cells at %lf m/cell, %d cell local map",
+               m->size(), m->resolution(), m->local_size());
+      } else {
+         ROS_ERROR("No %d cell map at %lf m/cell; keeping the current map",
+               map_wanted.size, map_wanted.resolution);
+         map_wanted.size = obstacle_map->size();
+         map_wanted.resolution = obstacle_map->resolution();
+         map_wanted.local_size = obstacle_map->local_size();
       }
-      map_pub.publish(map);
+      boost::mutex::scoped_lock lock(map_rebuild_mutex);
+      map_rebuild_done = false;
+      map_rebuilt = 0;
+      map_rebuilding = false;
+   }
+   if( !map_is(obstacle_map, map_wanted) ) {
+      map_rebuilding = true;
+      boost::thread(rebuildThread, obstacle_map, map_wanted).detach();
    }
-   */
-   return;
 }
 
 void reconfigureCb(path_planner::PathPlannerConfig & config, 
          uint32_t level) {
+   PiMutex::scoped_lock lock(planner_mutex);
    goal_err             = config.goal_err;
    cone_dist            = config.cone_dist;
    max_speed            = config.max_speed;
@@ -814,58 +1830,413 @@ void reconfigureCb(path_planner::PathPlannerConfig & config,
    stuck_timeout        = config.stuck_timeout;
    cone_timeout         = config.cone_timeout;
    cone_speed           = config.cone_speed;
+   cone_gain            = config.cone_gain;
+   cone_gate            = config.cone_gate;
+   cone_latency         = config.cone_latency;
    track_cones          = config.track_cones;
    min_radius           = config.min_radius;
    max_radius           = config.max_radius;
+   obstacle_decay       = config.obstacle_decay;
+   decimate_scans       = config.decimate_scans;
+   cloud_min_z          = config.cloud_min_z;
+   cloud_max_z          = config.cloud_max_z;
+   integration_window   = config.integration_window;
+   match_scans          = config.match_scans;
+   match_window         = config.match_window;
+   match_angle          = config.match_angle;
+   match_budget         = config.match_budget;
+   laser_offset         = config.laser_offset;
+
+   // the first call (level ~0) carries the defaults rather than a
+   //  request; report the map we started with instead
+   int size;
+   double res;
+   if( level == ~0u ) {
+      for( int k=0; ObstacleMap::geometry(k, size, res); k++ ) {
+         if( obstacle_map->size() == size &&
+               fabs(obstacle_map->resolution() - res) < 1e-4 ) {
+            config.map_geometry = k;
+         }
+      }
+      config.local_map_size = obstacle_map->local_size();
+   }
+   if( ObstacleMap::geometry(config.map_geometry, size, res) ) {
+      map_wanted.size = size;
+      map_wanted.resolution = res;
+   }
+   map_wanted.local_size = config.local_map_size;
+
+   integration_timer.setPeriod(ros::Duration(integration_window));
+   cone_servo.set_params(cone_gain, cone_gate, cone_timeout);
+
+   if( obstacle_decay > 0 ) {
+      decay_timer.setPeriod(ros::Duration(obstacle_decay));
+      decay_timer.start();
+   } else {
+      decay_timer.stop();
+   }
+}
+
+// batched queries from other nodes, in the odometry frame
+bool queryMapCb(path_planner::QueryMap::Request & req,
+      path_planner::QueryMap::Response & res) {
+   const size_t points = req.point_x.size();
+   const size_t rays = req.ray_x.size();
+   const size_t arcs = req.arc_x.size();
+   if( req.point_y.size() != points || req.ray_y.size() != rays ||
+         req.ray_theta.size() != rays || req.arc_y.size() != arcs ||
+         req.arc_theta.size() != arcs || req.arc_r.size() != arcs ||
+         req.arc_l.size() != arcs ) {
+      ROS_WARN("Map query with mismatched array lengths");
+      return false;
+   }
+
+   // the map walks queries in 16.16 fixed point, cell by cell. starts
+   //  and radii within a map width of the origin, and lengths within its
+   //  diagonal, keep that in range, and a query off the map from holding
+   //  planner_mutex for long
+   const double width = obstacle_map->size() * obstacle_map->resolution();
+   const double longest = width * M_SQRT2;
+
+   vector<map_query> q(points + rays + arcs);
+   for( size_t k=0; k<q.size(); k++ ) {
+      map_query & m = q[k];
+      odom_pose p;
+      m.r = 0.0;
+      m.l = 0.0;
+      if( k < points ) {
+         m.type = map_query::POINT;
+         p.x = req.point_x[k];
+         p.y = req.point_y[k];
+      } else if( k < points + rays ) {
+         const size_t i = k - points;
+         m.type = map_query::RAY;
+         p.x = req.ray_x[i];
+         p.y = req.ray_y[i];
+         p.theta = req.ray_theta[i];
+         m.l = req.max_range;
+      } else {
+         const size_t i = k - points - rays;
+         m.type = map_query::ARC;
+         p.x = req.arc_x[i];
+         p.y = req.arc_y[i];
+         p.theta = req.arc_theta[i];
+         m.r = req.arc_r[i];
+         m.l = req.arc_l[i];
+      }
+      if( !isfinite(p.x) || !isfinite(p.y) || !isfinite(p.theta) ||
+            !isfinite(m.r) || !isfinite(m.l) ) {
+         ROS_WARN("Map query with a NaN or infinite value");
+         return false;
+      }
+      if( fabs(p.x) > width || fabs(p.y) > width || fabs(m.r) > width ) {
+         ROS_WARN("Map query more than a map width from the origin");
+         return false;
+      }
+      m.l = std::max(0.0, std::min(m.l, longest));
+      p = correct(map_correction, p);
+      m.x = p.x;
+      m.y = p.y;
+      m.theta = p.theta;
+   }
+
+   vector<map_answer> a;
+   {
+      PiMutex::scoped_lock lock(planner_mutex);
+      answer_queries(*obstacle_map, q, a);
+   }
+
+   res.point_clear.resize(points);
+   res.point_cost.resize(points);
+   res.ray_range.resize(rays);
+   res.arc_clear.resize(arcs);
+   for( size_t k=0; k<points; k++ ) {
+      res.point_clear[k] = a[k].clear;
+      res.point_cost[k] = a[k].cost;
+   }
+   for( size_t k=0; k<rays; k++ ) {
+      res.ray_range[k] = a[points + k].range;
+   }
+   for( size_t k=0; k<arcs; k++ ) {
+      res.arc_clear[k] = a[points + rays + k].clear;
+   }
+   return true;
 }
 
 void bumpCb(const std_msgs::Bool::ConstPtr & msg ) {
+   PiMutex::scoped_lock lock(planner_mutex);
    bump = msg->data;
 }
 
 void conesCb(const visualization_msgs::Marker::ConstPtr & msg ) {
-   cones = *msg;
+   PiMutex::scoped_lock lock(planner_mutex);
+   if( !have_position_frame ) return;
+   if( msg->header.frame_id != position_frame ) {
+      ROS_WARN_THROTTLE(5.0, "Ignoring cones in %s frame; expected %s",
+            msg->header.frame_id.c_str(), position_frame.c_str());
+      return;
+   }
+   cones = msg;
+   cone_servo.laser(msg->header.stamp.toSec(), msg->points);
 }
 
 void visionCb(const std_msgs::Float32::ConstPtr & msg ) {
-   cone_time = ros::Time::now();
-   cone = msg->data;
+   // the bearing has no stamp of its own
+   PiMutex::scoped_lock lock(planner_mutex);
+   ros::Time seen = ros::Time::now() - ros::Duration(cone_latency);
+   cone_servo.vision(seen.toSec(), msg->data);
+   if( cones ) cone_servo.laser(cones->header.stamp.toSec(), cones->points);
 }
 
-int main(int argc, char ** argv) {
-   map_data = (map_type*)malloc(MAP_SIZE * MAP_SIZE * sizeof(map_type));
-   // set map to empty
-   for( int i=0; i<MAP_SIZE; i++ ) {
-      for( int j=0; j<MAP_SIZE; j++ ) {
-         map_data[i*MAP_SIZE + j] = 0;
-      }
+// log percentiles of each latency every so often
+ros::Timer latency_timer;
+
+void report_latency(const char * name, LatencyStats & stats) {
+   latency_summary l = stats.take();
+   if( l.count == 0 ) return;
+   ROS_INFO("%s: %llu samples, p50 %.0f p99 %.0f p99.9 %.0f max %.0f us",
+         name, (unsigned long long)l.count, l.p50, l.p99, l.p999, l.max);
+}
+
+void latencyCb(const ros::TimerEvent &) {
+   report_latency("Odometry latency", odom_latency);
+   report_latency("Planner lock wait", control_wait);
+   report_latency("Control cycle", control_cycle);
+}
+
+// runs positionCallback, and nothing else, off its own queue
+void controlThread(ros::CallbackQueue * queue, int priority,
+      std::vector<int> cpus) {
+   std::string error;
+   if( !cpus.empty() && !rt_set_affinity(cpus, error) ) {
+      ROS_WARN("Control thread not pinned to its CPUs: %s", error.c_str());
    }
+   if( !rt_set_fifo(priority, error) ) {
+      ROS_WARN("Control thread not real-time; running at normal priority: "
+            "%s", error.c_str());
+   }
+   rt_prefault_stack(256 * 1024);
+   while( ros::ok() ) {
+      queue->callAvailable(ros::WallDuration(0.1));
+   }
+}
 
+int main(int argc, char ** argv) {
    ros::init(argc, argv, "path_planner");
+   mem_name_tags(mem_tag_names, MEM_TAGS);
 
    ros::NodeHandle n;
 
+   int realtime_priority = 40;
+   std::vector<int> realtime_cpus;
+   n.getParam("realtime", realtime);
+   n.getParam("realtime_priority", realtime_priority);
+   n.getParam("realtime_cpus", realtime_cpus);
+
+   // map geometry and memory are fixed for the life of the node
+   int map_size = 5000;
+   double map_resolution = 0.10;
+   std::string map_pages_param = "transparent";
+   n.getParam("map_size", map_size);
+   n.getParam("map_resolution", map_resolution);
+   n.getParam("map_pages", map_pages_param);
+   n.getParam("map_numa_node", map_numa_node);
+   n.getParam("prefault_radius", prefault_radius);
+   map_pages_wanted = map_pages_from_string(map_pages_param.c_str());
+   obstacle_map = ObstacleMap::create(map_size, map_resolution,
+         map_pages_wanted, map_numa_node);
+   if( !obstacle_map ) {
+      ROS_ERROR("No %d cell map at %lf m/cell; using 5000 cells at 0.10",
+            map_size, map_resolution);
+      obstacle_map = ObstacleMap::create(5000, 0.10, map_pages_wanted,
+            map_numa_node);
+   }
+   if( obstacle_map->pages() != map_pages_wanted ) {
+      ROS_WARN("No %s pages for the map; fell back to %s pages",
+            map_pages_name(map_pages_wanted),
+            map_pages_name(obstacle_map->pages()));
+   }
+   map_wanted.size = obstacle_map->size();
+   map_wanted.resolution = obstacle_map->resolution();
+   map_wanted.local_size = obstacle_map->local_size();
+   int raytrace_threads = std::min(4u,
+         std::max(1u, boost::thread::hardware_concurrency()));
+   n.getParam("raytrace_threads", raytrace_threads);
+   if( raytrace_threads > 1 ) {
+      raytrace_pool = new WorkerPool(raytrace_threads);
+   }
+   cloud_bins = new CloudBins(obstacle_map->local_size(),
+         obstacle_map->resolution());
+
+   // locking memory faults in every page of every layer now, rather than
+   //  as the robot drives: the static and inflation layers too, whose
+   //  untouched pages would otherwise cost nothing, and a whole second
+   //  map while one is rebuilt. it all has to fit in RAM, and under the
+   //  memlock limit
+   if( realtime ) {
+      const uint64_t map_bytes = mem_read(MEM_MAP).bytes +
+         mem_read(MEM_PYRAMID).bytes;
+      ROS_INFO("Locking memory; the map keeps %llu MB resident, twice "
+            "that while it's rebuilt",
+            (unsigned long long)(map_bytes >> 20));
+      std::string error;
+      if( !rt_lock_memory(error) ) {
+         ROS_WARN("Memory not locked: %s", error.c_str());
+      }
+   }
+
    // set up tf2 transform listener
    tf2_ros::TransformListener tf2_listener(tf2_buffer);
 
-   // subscribe to our location and current goal
-   ros::Subscriber odom_sub = n.subscribe("position", 2, positionCallback);
+   // subscribe to our location and current goal. when real-time, odometry
+   //  has a queue, and a thread, of its own; see controlThread
+   ros::NodeHandle control_n;
+   ros::CallbackQueue control_queue;
+   if( realtime ) control_n.setCallbackQueue(&control_queue);
+   ros::Subscriber odom_sub = control_n.subscribe("position", 2,
+         positionCallback);
    ros::Subscriber goal_sub = n.subscribe("current_goal", 2, goalCallback);
-   ros::Subscriber laser_sub = n.subscribe("scan", 2, laserCallback);
+   goal_timer = n.createTimer(ros::Duration(0.1), goalCb);
+
+   // one subscription per scanner; all of them feed one integration pass
+   vector<std::string> scan_topics;
+   if( !n.getParam("scan_topics", scan_topics) || scan_topics.empty() ) {
+      scan_topics.push_back("scan");
+   }
+   n.getParam("base_frame", base_frame);
+   n.getParam("map_frame", map_frame);
+   n.getParam("utm_frame", utm_frame);
+   correction_broadcaster = new tf2_ros::TransformBroadcaster();
+   ros::NodeHandle scan_n;
+   ros::CallbackQueue scan_queue;
+   scan_n.setCallbackQueue(&scan_queue);
+   scan_sources.resize(scan_topics.size());
+   for( size_t i=0; i<scan_topics.size(); i++ ) {
+      scan_sources[i].topic = scan_topics[i];
+      scan_sources[i].have_extrinsic = false;
+      scan_sources[i].have_seq = false;
+      scan_sources[i].sub = scan_n.subscribe<sensor_msgs::LaserScan>(
+            scan_topics[i], 10, boost::bind(laserCallback, _1, (int)i));
+   }
+   ros::Subscriber cloud_sub = n.subscribe("points", 1, cloudCallback);
    ros::Subscriber bump_sub = n.subscribe("bump", 2, bumpCb);
    ros::Subscriber cones_sub = n.subscribe("cone_markers", 2, conesCb);
 
    ros::Subscriber vision_sub = n.subscribe("top_cam/cone_angle", 2, visionCb);
 
    cmd_pub = n.advertise<geometry_msgs::Twist>("cmd_vel", 10);
-   map_pub = n.advertise<nav_msgs::OccupancyGrid>("map", 1);
    path_pub = n.advertise<nav_msgs::Path>("path", 10);
    done_pub = n.advertise<std_msgs::Bool>("goal_reached", 1);
+   decimation_pub = n.advertise<std_msgs::Float32>("scan_decimation", 1);
+   dropped_pub = n.advertise<std_msgs::UInt32>("scans_dropped", 1, true);
+   ros::ServiceServer query_srv = n.advertiseService("query_map",
+         queryMapCb);
+
+   decay_timer = n.createTimer(ros::Duration(obstacle_decay), decayCb);
+   catch_up_timer = n.createTimer(ros::Duration(0.1), catchUpCb);
+   integration_timer = n.createTimer(ros::Duration(integration_window),
+         integrateCb);
+   rebuild_timer = n.createTimer(ros::Duration(0.2), rebuildCb);
+   if( realtime ) {
+      show_timer = n.createTimer(ros::Duration(0.1), showCb);
+   }
+   double realtime_report = 10.0;
+   n.getParam("realtime_report", realtime_report);
+   if( realtime_report > 0 ) {
+      latency_timer = n.createTimer(ros::Duration(realtime_report),
+            latencyCb);
+   }
+
+   // evidence shared with other robots
+   bool share = false;
+   n.getParam("map_share", share);
+   if( share ) {
+      int robot_id = 0;
+      double share_rate = 1.0;
+      n.getParam("share_origin_x", share_origin_x);
+      n.getParam("share_origin_y", share_origin_y);
+      n.getParam("share_rate", share_rate);
+      n.getParam("share_bandwidth", share_bandwidth);
+      if( !n.getParam("share_robot_id", robot_id) || share_rate <= 0 ) {
+         ROS_ERROR("Map sharing needs a share_robot_id, unique among the "
+               "robots, and a positive share_rate; not sharing");
+      } else {
+         share_transport = new RosShareTransport(n);
+         map_share = new MapShare(robot_id, *share_transport);
+         share_timer = n.createTimer(ros::Duration(1.0 / share_rate),
+               shareCb);
+      }
+   }
+
+   // the map in shared memory; an empty name disables it
+   std::string map_shm_name = "/path_planner_map";
+   double map_shm_rate = 5.0;
+   n.getParam("map_shm_name", map_shm_name);
+   n.getParam("map_shm_rate", map_shm_rate);
+   if( !map_shm_name.empty() && map_shm_rate > 0 ) {
+      map_shm = new MapShmWriter(map_shm_name);
+      map_shm_timer = n.createTimer(ros::Duration(1.0 / map_shm_rate),
+            mapShmCb);
+   }
+
+   // memory per subsystem; 0 disables
+   double memory_rate = 0.2;
+   n.getParam("memory_rate", memory_rate);
+   if( memory_rate > 0 ) {
+      memory_pub = n.advertise<mem_account::MemoryUsage>("memory_usage", 1);
+      memory_timer = n.createTimer(ros::Duration(1.0 / memory_rate),
+            memoryCb);
+   }
+
+   // keepout zones from a parameter and/or a file; see keepout.h
+   XmlRpc::XmlRpcValue keepout_list;
+   if( n.getParam("keepout_zones", keepout_list) &&
+         !keepout_param(keepout_list, keepout_zones) ) {
+      ROS_ERROR("Malformed keepout_zones parameter; ignored");
+      keepout_zones.clear();
+   }
+   std::string keepout_file;
+   if( n.getParam("keepout_file", keepout_file) && !keepout_file.empty() ) {
+      std::string error;
+      if( !load_keepout_file(keepout_file, keepout_zones, error) ) {
+         ROS_ERROR("Keepout zones not loaded: %s", error.c_str());
+      }
+   }
+   if( !keepout_zones.empty() ) {
+      ROS_INFO("%zu keepout zones", keepout_zones.size());
+      keepout_timer = n.createTimer(ros::Duration(1.0), keepoutCb);
+   }
 
    dynamic_reconfigure::Server<path_planner::PathPlannerConfig> server;
    server.setCallback(boost::bind(&reconfigureCb, _1, _2));
 
+   if( prefault_radius > 0 ) {
+      boost::thread prefault(prefaultThread);
+      prefault.detach();
+   }
+
+   // scans have a thread of their own; see laserCallback
+   ros::AsyncSpinner scan_spinner(1, &scan_queue);
+   scan_spinner.start();
+
+   boost::thread control;
+   boost::thread control_output;
+   if( realtime ) {
+      sem_init(&control_wake, 0, 0);
+      control_output = boost::thread(controlOutThread);
+      control = boost::thread(controlThread, &control_queue,
+            realtime_priority, realtime_cpus);
+   }
+
    ROS_INFO("Path planner ready");
 
    ros::spin();
+   if( realtime ) {
+      control.join();
+      sem_post(&control_wake);
+      control_output.join();
+   }
+
+   // take the shared-memory map down with us
+   delete map_shm;
 }
@@ -0,0 +1,98 @@
+/* perf_counters.cpp
+ *
+ * Hardware performance counters for benchmarks, through perf_event_open.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include <path_planner/perf_counters.h>
+
+static int open_counter(uint32_t type, uint64_t config) {
+   struct perf_event_attr attr;
+   memset(&attr, 0, sizeof(attr));
+   attr.size = sizeof(attr);
+   attr.type = type;
+   attr.config = config;
+   attr.disabled = 1;
+   attr.exclude_kernel = 1;
+   attr.exclude_hv = 1;
+   attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+      PERF_FORMAT_TOTAL_TIME_RUNNING;
+   return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+PerfCounters::PerfCounters() {
+   fd_[CYCLES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+   fd_[INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE,
+         PERF_COUNT_HW_INSTRUCTIONS);
+   fd_[CACHE_MISSES] = open_counter(PERF_TYPE_HARDWARE,
+         PERF_COUNT_HW_CACHE_MISSES);
+   fd_[BRANCH_MISSES] = open_counter(PERF_TYPE_HARDWARE,
+         PERF_COUNT_HW_BRANCH_MISSES);
+   fd_[DTLB_MISSES] = open_counter(PERF_TYPE_HW_CACHE,
+         PERF_COUNT_HW_CACHE_DTLB |
+         (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+}
+
+PerfCounters::~PerfCounters() {
+   for( int c=0; c<COUNTERS; c++ ) {
+      if( fd_[c] >= 0 ) close(fd_[c]);
+   }
+}
+
+void PerfCounters::start() {
+   for( int c=0; c<COUNTERS; c++ ) {
+      if( fd_[c] >= 0 ) {
+         ioctl(fd_[c], PERF_EVENT_IOC_RESET, 0);
+         ioctl(fd_[c], PERF_EVENT_IOC_ENABLE, 0);
+      }
+   }
+}
+
+void PerfCounters::stop() {
+   for( int c=0; c<COUNTERS; c++ ) {
+      if( fd_[c] >= 0 ) ioctl(fd_[c], PERF_EVENT_IOC_DISABLE, 0);
+   }
+}
+
+bool PerfCounters::any_available() const {
+   for( int c=0; c<COUNTERS; c++ ) {
+      if( fd_[c] >= 0 ) return true;
+   }
+   return false;
+}
+
+uint64_t PerfCounters::value(counter c) const {
+   // count, time enabled, time running
+   uint64_t v[3];
+   if( fd_[c] < 0 || read(fd_[c], v, sizeof(v)) != sizeof(v) ) {
+      return 0;
+   }
+   if( v[2] == 0 ) return 0;
+   if( v[2] < v[1] ) return (uint64_t)((double)v[0] * v[1] / v[2]);
+   return v[0];
+}
+
+const char * PerfCounters::name(counter c) {
+   switch( c ) {
+      case CYCLES:
+         return "cycles";
+      case INSTRUCTIONS:
+         return "instructions";
+      case CACHE_MISSES:
+         return "cache-misses";
+      case BRANCH_MISSES:
+         return "branch-misses";
+      case DTLB_MISSES:
+         return "dTLB-load-misses";
+      default:
+         return "?";
+   }
+}
@@ -0,0 +1,84 @@
+/* realtime.cpp
+ *
+ * Helpers for running a control thread under real-time scheduling.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <alloca.h>
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <path_planner/realtime.h>
+
+bool rt_set_fifo(int priority, std::string & error) {
+   struct sched_param param;
+   memset(&param, 0, sizeof(param));
+   param.sched_priority = priority;
+   int e = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+   if( e != 0 ) {
+      error = strerror(e);
+      return false;
+   }
+   return true;
+}
+
+bool rt_set_affinity(const std::vector<int> & cpus, std::string & error) {
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   for( size_t k=0; k<cpus.size(); k++ ) {
+      if( cpus[k] < 0 || cpus[k] >= CPU_SETSIZE ) {
+         error = "no such CPU";
+         return false;
+      }
+      CPU_SET(cpus[k], &set);
+   }
+   int e = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+   if( e != 0 ) {
+      error = strerror(e);
+      return false;
+   }
+   return true;
+}
+
+bool rt_lock_memory(std::string & error) {
+   if( mlockall(MCL_CURRENT | MCL_FUTURE) != 0 ) {
+      error = strerror(errno);
+      return false;
+   }
+   return true;
+}
+
+// noinline, so the buffer really is on the stack below the caller's frame
+__attribute__((noinline)) void rt_prefault_stack(size_t bytes) {
+   volatile char * stack = (volatile char*)alloca(bytes);
+   for( size_t k=0; k<bytes; k += 4096 ) stack[k] = 0;
+}
+
+PiMutex::PiMutex() {
+   pthread_mutexattr_t attr;
+   pthread_mutexattr_init(&attr);
+   pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+   if( pthread_mutex_init(&mutex_, &attr) != 0 ) {
+      pthread_mutex_init(&mutex_, 0);
+   }
+   pthread_mutexattr_destroy(&attr);
+}
+
+PiMutex::~PiMutex() {
+   pthread_mutex_destroy(&mutex_);
+}
+
+void PiMutex::lock() {
+   pthread_mutex_lock(&mutex_);
+}
+
+void PiMutex::unlock() {
+   pthread_mutex_unlock(&mutex_);
+}
+
+bool PiMutex::try_lock() {
+   return pthread_mutex_trylock(&mutex_) == 0;
+}
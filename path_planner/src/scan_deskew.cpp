@@ -0,0 +1,40 @@
+/* scan_deskew.cpp
+ *
+ * Per-beam laser poses for a scan taken while the robot was moving.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <math.h>
+
+#include <path_planner/scan_deskew.h>
+
+void deskew_beams(const odom_pose & start, const odom_pose & end,
+      const odom_pose & laser, double angle_min, double angle_increment,
+      size_t n, double * x, double * y, double * theta) {
+   double dtheta = end.theta - start.theta;
+   while( dtheta > M_PI )  dtheta -= 2.0 * M_PI;
+   while( dtheta < -M_PI ) dtheta += 2.0 * M_PI;
+
+   // laser origin at the first and last beam
+   double c0 = cos(start.theta);
+   double s0 = sin(start.theta);
+   double c1 = cos(start.theta + dtheta);
+   double s1 = sin(start.theta + dtheta);
+   double x0 = start.x + laser.x * c0 - laser.y * s0;
+   double y0 = start.y + laser.x * s0 + laser.y * c0;
+   double x1 = end.x + laser.x * c1 - laser.y * s1;
+   double y1 = end.y + laser.x * s1 + laser.y * c1;
+
+   double f = n > 1 ? 1.0 / (n - 1) : 0.0;
+   double dx = (x1 - x0) * f;
+   double dy = (y1 - y0) * f;
+   double th0 = start.theta + laser.theta + angle_min;
+   double dth = angle_increment + dtheta * f;
+
+   for( size_t i=0; i<n; i++ ) {
+      x[i] = x0 + i * dx;
+      y[i] = y0 + i * dy;
+      theta[i] = th0 + i * dth;
+   }
+}
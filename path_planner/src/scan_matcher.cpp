@@ -0,0 +1,240 @@
+/* scan_matcher.cpp
+ *
+ * Correlative scan-to-map matcher, for correcting odometry drift.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <math.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include <path_planner/costmap_layer.h>
+#include <path_planner/grid.h>
+#include <path_planner/scan_matcher.h>
+
+// most points we'll match; more only costs time
+#define MAX_POINTS 256
+// fewest points worth matching
+#define MIN_POINTS 20
+
+odom_pose correct(const correction & c, const odom_pose & p) {
+   const double cs = cos(c.theta);
+   const double sn = sin(c.theta);
+   odom_pose out = p;
+   out.x = cs*p.x - sn*p.y + c.x;
+   out.y = sn*p.x + cs*p.y + c.y;
+   out.theta = p.theta + c.theta;
+   return out;
+}
+
+correction compose(const correction & c, const correction & d) {
+   const double cs = cos(c.theta);
+   const double sn = sin(c.theta);
+   correction out;
+   out.x = cs*d.x - sn*d.y + c.x;
+   out.y = sn*d.x + cs*d.y + c.y;
+   out.theta = atan2(sin(c.theta + d.theta), cos(c.theta + d.theta));
+   return out;
+}
+
+static double now() {
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+ScanMatcher::ScanMatcher(int size, int block) : size_(size), block_(block),
+   res_(0.0), cx_(0.0), cy_(0.0), window_(size * size), hi_(size * size),
+   lo_(size * size), score_(0.0) {
+}
+
+void ScanMatcher::read(ObstacleMap & map, double x, double y) {
+   res_ = map.resolution();
+   map.read_window(x, y, size_, &window_[0], cx_, cy_);
+}
+
+void ScanMatcher::build() {
+   const int S = size_;
+
+   // depth of each cell inside the occupied region: city-block distance
+   //  to the nearest empty cell, in two chamfer passes. anything past the
+   //  edge of the window counts as empty. capped a cell past the
+   //  inflation radius, which is where the obstacle itself is. keepout
+   //  zones aren't anything the laser can see, so they count as empty
+   const int cap = std::min(0.4 / res_ + 1.0, 255.0);
+   for( int i=0; i<S; i++ ) {
+      for( int j=0; j<S; j++ ) {
+         int d = 0;
+         map_type c = window_[i*S + j];
+         if( c > 0 && c != COST_KEEPOUT ) {
+            d = cap;
+            if( i > 0 ) d = std::min(d, hi_[(i-1)*S + j] + 1);
+            else d = 1;
+            if( j > 0 ) d = std::min(d, hi_[i*S + j-1] + 1);
+            else d = 1;
+         }
+         hi_[i*S + j] = d;
+      }
+   }
+   for( int i=S-1; i>=0; i-- ) {
+      for( int j=S-1; j>=0; j-- ) {
+         int d = hi_[i*S + j];
+         if( d > 1 ) {
+            if( i < S-1 ) d = std::min(d, hi_[(i+1)*S + j] + 1);
+            else d = 1;
+            if( j < S-1 ) d = std::min(d, hi_[i*S + j+1] + 1);
+            else d = 1;
+         }
+         hi_[i*S + j] = d;
+      }
+   }
+
+   // low-res table: max over each block x block window, as a sliding max
+   //  along j and then along i
+   const int B = block_;
+   for( int i=0; i<S; i++ ) {
+      for( int j=0; j<S; j++ ) {
+         uint8_t m = 0;
+         for( int k=j; k<std::min(j + B, S); k++ ) {
+            m = std::max(m, hi_[i*S + k]);
+         }
+         lo_[i*S + j] = m;
+      }
+   }
+   for( int j=0; j<S; j++ ) {
+      for( int i=0; i<S; i++ ) {
+         uint8_t m = lo_[i*S + j];
+         for( int k=i+1; k<std::min(i + B, S); k++ ) {
+            m = std::max(m, lo_[k*S + j]);
+         }
+         // rows below i are still unmodified, so this is safe in place
+         lo_[i*S + j] = m;
+      }
+   }
+}
+
+int ScanMatcher::sum(const uint8_t * table, const std::vector<int> & pts,
+      int offset) {
+   int s = 0;
+   for( size_t k=0; k<pts.size(); k++ ) {
+      s += table[pts[k] + offset];
+   }
+   return s;
+}
+
+// a block of translations at one rotation, and its score bound
+struct match_candidate {
+   int bound;
+   int t;
+   int dx;
+   int dy;
+};
+
+static bool better_bound(const match_candidate & a,
+      const match_candidate & b) {
+   return a.bound > b.bound;
+}
+
+bool ScanMatcher::match(double x, double y,
+      const std::vector<double> & px, const std::vector<double> & py,
+      double window, double angle, double budget, correction & out) {
+   const double start = now();
+   build();
+
+   const int S = size_;
+   const int B = block_;
+   const int W = ceil(window / res_);
+   const int C = S / 2;
+
+   // keep points that stay inside the tables at any correction
+   const double reach = (C - W - 2) * res_;
+   std::vector<int> keep;
+   double rmax = res_;
+   for( size_t k=0; k<px.size(); k++ ) {
+      double r = hypot(px[k], py[k]);
+      if( r < reach ) {
+         keep.push_back(k);
+         rmax = std::max(rmax, r);
+      }
+   }
+   if( (int)keep.size() < MIN_POINTS ) return false;
+   const size_t stride = (keep.size() + MAX_POINTS - 1) / MAX_POINTS;
+
+   // angular step: the farthest point moves about one cell per step
+   const double dtheta = res_ / rmax;
+   const int nt = ceil(angle / dtheta);
+
+   // table index of every point, at every rotation
+   const double ox = (x - cx_) / res_;
+   const double oy = (y - cy_) / res_;
+   rotated_.resize(2*nt + 1);
+   for( int t=0; t<=2*nt; t++ ) {
+      const double c = cos((t - nt) * dtheta) / res_;
+      const double s = sin((t - nt) * dtheta) / res_;
+      std::vector<int> & pts = rotated_[t];
+      pts.clear();
+      for( size_t k=0; k<keep.size(); k += stride ) {
+         double qx = px[keep[k]];
+         double qy = py[keep[k]];
+         int u = C + fixed_cell(to_fixed(ox + c*qx - s*qy));
+         int v = C + fixed_cell(to_fixed(oy + s*qx + c*qy));
+         pts.push_back(u*S + v);
+      }
+   }
+
+   // no correction is the one to beat; ties keep it
+   int best = sum(&hi_[0], rotated_[nt], 0);
+   int best_t = nt;
+   int best_dx = 0;
+   int best_dy = 0;
+
+   // bound every block of translations at every rotation
+   static std::vector<match_candidate> candidates;
+   candidates.clear();
+   for( int t=0; t<=2*nt; t++ ) {
+      for( int dx = -W; dx <= W; dx += B ) {
+         for( int dy = -W; dy <= W; dy += B ) {
+            match_candidate m;
+            m.bound = sum(&lo_[0], rotated_[t], dx*S + dy);
+            if( m.bound > best ) {
+               m.t = t;
+               m.dx = dx;
+               m.dy = dy;
+               candidates.push_back(m);
+            }
+         }
+      }
+   }
+   std::sort(candidates.begin(), candidates.end(), better_bound);
+
+   // refine the most promising blocks until none could beat the best
+   for( size_t k=0; k<candidates.size(); k++ ) {
+      const match_candidate & m = candidates[k];
+      if( m.bound <= best ) break;
+      if( now() - start > budget ) return false;
+      for( int dx = m.dx; dx < std::min(m.dx + B, W + 1); dx++ ) {
+         for( int dy = m.dy; dy < std::min(m.dy + B, W + 1); dy++ ) {
+            int s = sum(&hi_[0], rotated_[m.t], dx*S + dy);
+            if( s > best ) {
+               best = s;
+               best_t = m.t;
+               best_dx = dx;
+               best_dy = dy;
+            }
+         }
+      }
+   }
+
+   score_ = (double)best / rotated_[nt].size();
+   if( best == 0 ) return false;
+
+   // rotate about the robot, then translate
+   out.theta = (best_t - nt) * dtheta;
+   const double cs = cos(out.theta);
+   const double sn = sin(out.theta);
+   out.x = x + best_dx * res_ - (cs*x - sn*y);
+   out.y = y + best_dy * res_ - (sn*x + cs*y);
+   return true;
+}
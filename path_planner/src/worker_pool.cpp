@@ -0,0 +1,67 @@
+/* worker_pool.cpp
+ *
+ * A fixed set of threads that split a job with the thread that asks for
+ * it.
+ *
+ * Author: Austin Hendrix
+ */
+
+#include <algorithm>
+
+#include <path_planner/worker_pool.h>
+
+WorkerPool::WorkerPool(int threads) : generation_(0), n_(0), pending_(0),
+   stop_(false), job_(0) {
+   for( int k=1; k<threads; k++ ) {
+      workers_.push_back(new boost::thread(&WorkerPool::work, this, k));
+   }
+}
+
+WorkerPool::~WorkerPool() {
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      stop_ = true;
+   }
+   start_.notify_all();
+   for( size_t k=0; k<workers_.size(); k++ ) {
+      workers_[k]->join();
+      delete workers_[k];
+   }
+}
+
+void WorkerPool::run(int n, const boost::function<void (int)> & job) {
+   n = std::min(n, size());
+   if( n > 1 ) {
+      boost::mutex::scoped_lock lock(mutex_);
+      job_ = &job;
+      n_ = n;
+      pending_ = n - 1;
+      ++generation_;
+      start_.notify_all();
+   }
+
+   job(0);
+
+   if( n > 1 ) {
+      boost::mutex::scoped_lock lock(mutex_);
+      while( pending_ > 0 ) done_.wait(lock);
+      job_ = 0;
+   }
+}
+
+void WorkerPool::work(int k) {
+   unsigned seen = 0;
+   boost::mutex::scoped_lock lock(mutex_);
+   while( true ) {
+      while( !stop_ && generation_ == seen ) start_.wait(lock);
+      if( stop_ ) return;
+      seen = generation_;
+      if( k >= n_ ) continue;
+
+      const boost::function<void (int)> & job = *job_;
+      lock.unlock();
+      job(k);
+      lock.lock();
+      if( --pending_ == 0 ) done_.notify_one();
+   }
+}